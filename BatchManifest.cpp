@@ -0,0 +1,115 @@
+#include "BatchManifest.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QRegularExpression>
+
+namespace {
+
+bool isValid(const BatchManifest::Job& job, QString& error)
+{
+    if (job.type.isEmpty() || job.destination.isEmpty()) {
+        error = QString{"job %1: type and destination are expected"}.arg(job.line);
+        return false;
+    }
+
+    if (job.width <= 0 || job.height <= 0) {
+        error = QString{"job %1: width and height should be positive integers"}.arg(job.line);
+        return false;
+    }
+    return true;
+}
+
+bool loadJson(const QByteArray& data, const BatchManifest::Job& defaults, std::vector<BatchManifest::Job>& jobs, QString& error)
+{
+    QJsonParseError parseError;
+    const QJsonDocument document = QJsonDocument::fromJson(data, &parseError);
+    if (document.isNull()) {
+        error = parseError.errorString();
+        return false;
+    }
+
+    const QJsonArray array = document.isArray() ? document.array() : document.object().value("jobs").toArray();
+    for (int i = 0; i < array.size(); ++i) {
+        BatchManifest::Job jobDefaults = defaults;
+        jobDefaults.line = i + 1;
+
+        BatchManifest::Job job;
+        if (!BatchManifest::fromJson(array.at(i).toObject(), jobDefaults, job, error)) {
+            return false;
+        }
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+bool loadText(const QByteArray& data, std::vector<BatchManifest::Job>& jobs, QString& error)
+{
+    static const QRegularExpression jobLine {R"(^(\S+)\s+(\S+)\s+(\S+)\s+(.+)$)"};
+
+    const QStringList lines = QString::fromUtf8(data).split('\n');
+    for (int i = 0; i < lines.size(); ++i) {
+        const QString line = lines.at(i).section('#', 0, 0).trimmed();
+        if (line.isEmpty()) {
+            continue;
+        }
+
+        const auto match = jobLine.match(line);
+        if (!match.hasMatch()) {
+            error = QString{"job %1: 'type width height destination' is expected"}.arg(i + 1);
+            return false;
+        }
+
+        BatchManifest::Job job;
+        job.type = match.captured(1);
+        job.width = match.captured(2).toInt();
+        job.height = match.captured(3).toInt();
+        job.destination = match.captured(4);
+        job.line = i + 1;
+
+        if (!isValid(job, error)) {
+            return false;
+        }
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+} // namespace
+
+bool BatchManifest::load(const QString& filePath, const Job& defaults, std::vector<Job>& jobs, QString& error)
+{
+    QFile file {filePath};
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        return false;
+    }
+
+    const QByteArray data = file.readAll();
+    const QByteArray start = data.trimmed().left(1);
+    if (start == "[" || start == "{") {
+        return loadJson(data, defaults, jobs, error);
+    }
+    return loadText(data, jobs, error);
+}
+
+bool BatchManifest::fromJson(const QJsonObject& object, const Job& defaults, Job& job, QString& error)
+{
+    job.type = object.value("type").toString(defaults.type);
+    job.width = object.value("width").toInt(defaults.width);
+    job.height = object.value("height").toInt(defaults.height);
+    job.destination = object.value("destination").toString(defaults.destination);
+    job.line = defaults.line;
+    return isValid(job, error);
+}
+
+QJsonObject BatchManifest::toJson(const Job& job)
+{
+    return QJsonObject{
+        {"type", job.type},
+        {"width", job.width},
+        {"height", job.height},
+        {"destination", job.destination}
+    };
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+
+#include <QJsonObject>
+#include <QString>
+
+/**
+ * List of patterns generated by one invocation. A manifest is either a JSON array
+ * of job objects (or an object with such "jobs" array):
+ *
+ *     [{"type": "rgb3x4", "width": 3840, "height": 2880, "destination": "/out/rgb.png"}]
+ *
+ * or plain text with one job per line, '#' starting a comment:
+ *
+ *     rgb3x4 3840 2880 /out/rgb.png
+ *
+ * where the destination takes the rest of the line. Fields left out in JSON
+ * take the values of the default job.
+ */
+struct BatchManifest
+{
+    struct Job
+    {
+        QString type;
+        int width = 0;
+        int height = 0;
+        QString destination;
+        int line = 0; // line of a text manifest or position in JSON array, for reporting
+    };
+
+    /**
+     * @brief load - reads jobs of the manifest at 'filePath'
+     * @param defaults - job providing fields missing in JSON jobs
+     * @param jobs - receives the jobs in manifest order
+     * @param error - receives description of the first problem found
+     * @return false if the manifest can not be read or has an invalid job
+     */
+    static bool load(const QString& filePath, const Job& defaults, std::vector<Job>& jobs, QString& error);
+
+    /**
+     * @brief fromJson - reads a single JSON job, fields it lacks are taken from 'defaults'
+     * @return false if the resulting job is invalid
+     */
+    static bool fromJson(const QJsonObject& object, const Job& defaults, Job& job, QString& error);
+
+    static QJsonObject toJson(const Job& job);
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/**
+ * Blocking FIFO holding at most 'capacity' items. Producers wait while it is
+ * full, which keeps the memory of a pipeline bounded.
+ */
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity)
+        : m_capacity(capacity > 0 ? capacity : 1)
+    {}
+
+    /**
+     * @brief push - waits for a free slot and appends 'item'
+     * @return false if queue was closed
+     */
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock {m_mutex};
+        m_notFull.wait(lock, [this] { return m_closed || m_items.size() < m_capacity; });
+        if (m_closed) {
+            return false;
+        }
+
+        m_items.push_back(std::move(item));
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief pop - waits for an item and takes it
+     * @return false if queue was closed and all items were taken
+     */
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock {m_mutex};
+        m_notEmpty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+        if (m_items.empty()) {
+            return false;
+        }
+
+        item = std::move(m_items.front());
+        m_items.pop_front();
+        m_notFull.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief close - rejects further items, queued ones can still be taken
+     */
+    void close()
+    {
+        std::lock_guard<std::mutex> lock {m_mutex};
+        m_closed = true;
+        m_notFull.notify_all();
+        m_notEmpty.notify_all();
+    }
+
+private:
+    const size_t m_capacity;
+    std::deque<T> m_items;
+    std::mutex m_mutex;
+    std::condition_variable m_notFull;
+    std::condition_variable m_notEmpty;
+    bool m_closed = false;
+};
@@ -1,29 +1,103 @@
 #include "CalibrationFactory.h"
-
+#include "DisplayList.h"
+#include "GlyphAtlas.h"
+#include "ImageEncoder.h"
+#include "MappedImage.h"
+#include "PatternBackends.h"
+#include "Profiler.h"
+#include "RasterKernels.h"
+#include "StampCache.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <tuple>
 #include <vector>
 
+#include <QFileInfo>
 #include <QImage>
+#include <QPageLayout>
 #include <QPainter>
-#include <QFontMetrics>
-#include <QLinearGradient>
+#include <QPdfWriter>
+#include <QSaveFile>
+#include <QSvgGenerator>
 
 namespace {
 
-const std::vector<QColor> RGB_SET = {
-    QColor{Qt::red},
-    QColor{Qt::green},
-    QColor{Qt::blue}
+constexpr std::array<QRgb, 3> RGB_SET = {{
+    qRgb(255, 0, 0),
+    qRgb(0, 255, 0),
+    qRgb(0, 0, 255)
+}};
+
+constexpr QRgb RGB_LABEL_COLOR = qRgb(0, 0, 0);
+
+constexpr std::array<QRgb, 2> ACT_SET = {{
+    qRgb(0, 64, 0),
+    qRgb(0, 127, 0),
+//    qRgb(0, 191, 0)
+}};
+
+/**
+ * Part of the pattern canvas covered by a target image: the pattern is laid out
+ * for the whole 'size' and the top-left pixel of the target maps to 'origin'.
+ * Views and bands are rendered through an integer translation only, so every
+ * pixel matches the one of a single full-canvas render.
+ */
+struct Viewport
+{
+    QSize size;
+    QPoint origin;
+
+    static Viewport whole(const QImage& image)
+    {
+        return {image.size(), QPoint{0, 0}};
+    }
 };
 
-const std::vector<QColor> ACT_SET = {
-    QColor{0, 64, 0},
-    QColor{0, 127, 0},
-//    QColor{0, 191, 0}
+const int GENERATOR_REVISION = 2;
+
+bool fastRasterEnabled = true;
+bool glyphAtlasEnabled = true;
+bool compactFormatsEnabled = true;
+bool viewDeltasEnabled = true;
+ImageEncoder::Settings encoderSettings;
+
+const QString LABEL_FONT_FAMILY = "Arrial";
+
+/**
+ * Label metrics of one pattern, the atlas is resolved once for all its cells.
+ */
+class Labels
+{
+public:
+    explicit Labels(QRgb color)
+        : m_color(color)
+    {}
+
+    QRgb color() const { return m_color; }
+
+    const GlyphAtlas& glyphs(int pixelSize)
+    {
+        if (!m_glyphs || m_glyphs->pixelSize() != pixelSize) {
+            m_glyphs = GlyphAtlas::get(LABEL_FONT_FAMILY, pixelSize, m_color);
+        }
+        return *m_glyphs;
+    }
+
+private:
+    QRgb m_color;
+    std::shared_ptr<const GlyphAtlas> m_glyphs;
 };
 
-std::vector<QColor> getColorsSet(const std::vector<QColor>& predefined, size_t size)
+template <size_t N>
+std::vector<QRgb> getColorsSet(const std::array<QRgb, N>& predefined, size_t size)
 {
-    std::vector<QColor> colorSet;
+    std::vector<QRgb> colorSet;
     colorSet.reserve(size);
 
     while (colorSet.size() < size) {
@@ -32,7 +106,7 @@ std::vector<QColor> getColorsSet(const std::vector<QColor>& predefined, size_t s
     return colorSet;
 }
 
-void drawRGBMatrix(QPainter& painter, const QRectF& boundRect, size_t matrixSize, const QString& text)
+void compileRGBMatrix(DisplayList& list, Labels& labels, const QRectF& boundRect, size_t matrixSize, const QString& text)
 {
     const qreal rows = matrixSize;
     const qreal columns = matrixSize;
@@ -40,13 +114,8 @@ void drawRGBMatrix(QPainter& painter, const QRectF& boundRect, size_t matrixSize
     qreal xOffset = 0;
     qreal yOffset = 0;
 
-    painter.setBrush(QBrush{Qt::black});
-    QFont f{"Arrial"};
-    f.setPixelSize(textPixelSize);
-    painter.setFont(f);
-
-    QFontMetrics fm = painter.fontMetrics();
-    const qreal textSize = std::max(fm.horizontalAdvance(text), fm.height());
+    const GlyphAtlas& glyphs = labels.glyphs(static_cast<int>(textPixelSize));
+    const qreal textSize = std::max(glyphs.horizontalAdvance(text), glyphs.height());
 
     for (size_t i = 0; i < rows; ++i) {
         yOffset = i * boundRect.height() / (rows - 1) + boundRect.y();
@@ -59,7 +128,6 @@ void drawRGBMatrix(QPainter& painter, const QRectF& boundRect, size_t matrixSize
                             qBound(boundRect.top(), yOffset - textSize / 2, boundRect.bottom() - textSize),
                             textSize, textSize};
 
-            painter.setBrush(QBrush{Qt::black});
             int allignV = Qt::AlignVCenter;
             int allignH = Qt::AlignHCenter;
 
@@ -75,29 +143,27 @@ void drawRGBMatrix(QPainter& painter, const QRectF& boundRect, size_t matrixSize
                 allignH = Qt::AlignRight;
             }
 
-            painter.drawText(textRect, allignH | allignV, text);
+            list.addText(textRect, allignH | allignV, text, glyphs.pixelSize(), labels.color());
         }
     }
 }
 
-bool makeRGBImpl(QImage& image, int rows, int columns)
+bool compileRGB(DisplayList& list, const QSize& size, int rows, int columns)
 {
-    QPainter painter;
-    if (image.width() <= 0 || image.height() <= 0 || rows <= 0 || columns <= 0 ||
-        !painter.begin(&image)) {
+    if (size.width() <= 0 || size.height() <= 0 || rows <= 0 || columns <= 0) {
         return false;
     }
 
-    const qreal imageWidth = image.width();
-    const qreal imageHeight = image.height();
+    const qreal imageWidth = size.width();
+    const qreal imageHeight = size.height();
+    const QRgb outline = QColor{Qt::black}.rgba();
     qreal xOffset = 0;
 
-    // draw colored columns
+    // colored columns
     const auto columnColors = getColorsSet(RGB_SET, columns);
     for (size_t i = 0; i < columnColors.size(); ++i) {
-        qreal width = i == columnColors.size() - 1 ? image.width() - xOffset : imageWidth / columnColors.size();
-        painter.setBrush(QBrush{columnColors[i]});
-        painter.drawRect(QRectF{xOffset, 0, width, imageHeight});
+        qreal width = i == columnColors.size() - 1 ? size.width() - xOffset : imageWidth / columnColors.size();
+        list.addRect(QRectF{xOffset, 0, width, imageHeight}, columnColors[i], outline, 1);
         xOffset += width;
     }
 
@@ -106,6 +172,7 @@ bool makeRGBImpl(QImage& image, int rows, int columns)
     const qreal cellHeight = imageHeight / rows;
     const auto innerMatrixSize = 3;
     int value = 0;
+    Labels labels {RGB_LABEL_COLOR};
 
     xOffset = 0;
     qreal yOffset = 0;
@@ -116,9 +183,9 @@ bool makeRGBImpl(QImage& image, int rows, int columns)
         for (int j = 0; j < columns; ++j) {
             xOffset = j * cellWidth + margin;
 
-            drawRGBMatrix(painter,
-                       {xOffset, yOffset, cellWidth - margin * 2 , cellHeight - margin * 2},
-                       innerMatrixSize, QString::number(value++));
+            compileRGBMatrix(list, labels,
+                             {xOffset, yOffset, cellWidth - margin * 2 , cellHeight - margin * 2},
+                             innerMatrixSize, QString::number(value++));
         }
     }
 
@@ -126,7 +193,10 @@ bool makeRGBImpl(QImage& image, int rows, int columns)
 }
 
 //////////////// ACT
-bool drawACTRows(QPainter& painter, qreal imageWidth, qreal imageHeight, int rows)
+constexpr QRgb ACT_PIN_COLOR = qRgb(0, 255, 0);
+
+template <typename StripeHandler>
+bool forEachACTStripe(qreal imageWidth, qreal imageHeight, int rows, StripeHandler handler)
 {
     if (rows <= 0) {
         return false;
@@ -136,17 +206,16 @@ bool drawACTRows(QPainter& painter, qreal imageWidth, qreal imageHeight, int row
     const auto colorsSet = getColorsSet(ACT_SET, coloredRowsNumber);
     const qreal height = imageHeight / coloredRowsNumber;
     qreal yOffset = 0;
-    painter.setPen(Qt::transparent);
 
     for (const auto& color : colorsSet) {
-        painter.setBrush(QBrush{color});
-        painter.drawRect(QRectF{0, yOffset, imageWidth, height});
+        handler(QRectF{0, yOffset, imageWidth, height}, color);
         yOffset += height;
     }
     return true;
 }
 
-bool drawACTColumns(QPainter& painter, qreal imageWidth, qreal imageHeight, int rows, int columns)
+template <typename PinHandler>
+bool forEachACTPin(qreal imageWidth, qreal imageHeight, int rows, int columns, PinHandler handler)
 {
     if (rows <= 0 || columns <= 0) {
         return false;
@@ -169,8 +238,6 @@ bool drawACTColumns(QPainter& painter, qreal imageWidth, qreal imageHeight, int
     qreal xOffset = 0;
     unsigned counter = 0;
 
-    painter.setPen(Qt::transparent);
-
     for (int i = 0; i < rows; ++i) {
         yOffset = i * stripeHeight * ACT_SET.size();
 
@@ -186,100 +253,87 @@ bool drawACTColumns(QPainter& painter, qreal imageWidth, qreal imageHeight, int
                     yPinPos = yOffset + pinsVSpace + stripeHeight * k;
                 }
 
-                painter.setBrush(QBrush{QColor{0, 255, 0}});
-                QRectF pinRect{xPos - pinWidthHalf, yPinPos, pinWidth, pinHeight};
-                painter.drawRect(pinRect);
-
-                QLinearGradient gradient {pinRect.topLeft(), pinRect.bottomRight()};
-                gradient.setColorAt(0, Qt::transparent);
-                gradient.setColorAt(1, Qt::black);
-
-                QBrush gradientBrush{gradient};
-                gradientBrush.setStyle(Qt::BrushStyle::LinearGradientPattern);
-                painter.setBrush(gradientBrush);
-                painter.drawRect(pinRect);
+                handler(QRectF{xPos - pinWidthHalf, yPinPos, pinWidth, pinHeight});
             }
         }
     }
     return true;
 }
 
-bool makeACTImpl(QImage& image, int rows, int columns)
+/**
+ * ACT is made of opaque stripes and shaded pins only, so its list is rasterizable
+ * and written straight into scanlines whenever the image format allows it.
+ */
+bool compileACT(DisplayList& list, const QSize& size, int rows, int columns)
 {
-    QPainter painter;
-    if (image.width() <= 0 || image.height() <= 0 || rows <= 0 || columns <= 0 ||
-        !painter.begin(&image)) {
+    if (size.width() <= 0 || size.height() <= 0 || rows <= 0 || columns <= 0) {
         return false;
     }
 
-    return drawACTRows(painter, image.width(), image.height(), rows) &&
-           drawACTColumns(painter, image.width(), image.height(), rows, columns);
+    return forEachACTStripe(size.width(), size.height(), rows, [&](const QRectF& stripeRect, QRgb color) {
+        list.addRect(stripeRect, color, QColor{Qt::transparent}.rgba(), 1);
+    }) && forEachACTPin(size.width(), size.height(), rows, columns, [&](const QRectF& pinRect) {
+        list.addShadedRect(pinRect, ACT_PIN_COLOR, true);
+    });
 }
 
 //////////////////////////// ALIGN BAR
-void drawAbarGrid(QPainter& painter, QRectF boundingRect, int gridRows, int gridColumns, int barIndex)
+constexpr QRgb ABAR_LABEL_COLOR = qRgb(117, 251, 76);
+constexpr QRgb ABAR_HALF_CELL_COLOR = qRgb(83, 177, 54);
+constexpr QRgb ABAR_GRID_COLOR = qRgb(122, 122, 122);
+
+void addAbarHighlight(DisplayList& list, const QRectF& rect, QRgb color)
+{
+    list.addRect(rect, color, QColor{Qt::black}.rgba(), 1, true);
+}
+
+void compileAbarGrid(DisplayList& list, Labels& labels, QRectF boundingRect, int gridRows, int gridColumns, int barIndex)
 {
     const qreal text2BoundingRectMargin = 5;
     const qreal fontPixelSize = qMax(10.0, qMin(boundingRect.width() / gridColumns, boundingRect.height() / gridRows));
     const qreal gridCellWidth = boundingRect.width() / gridColumns;
     const qreal gridCellHeight = (boundingRect.height() - fontPixelSize - text2BoundingRectMargin) / gridRows;
     const qreal penWidth = 1.0;
-    QFont font {"Arrial"};
-    font.setPixelSize(fontPixelSize);
+    const GlyphAtlas& glyphs = labels.glyphs(static_cast<int>(fontPixelSize));
 
     const QString str = QString::number(barIndex);
-    const QSizeF textSize = QFontMetrics{font}.size(Qt::TextSingleLine, str);
-    qreal xCell = 0;
-    qreal yCell = 0;
+    const QSizeF textSize = glyphs.size(str);
 
-    // draw grid cells with background
+    // highlighted cells and label first, the grid lattice always ends up on top of them
     for (int k = 0; k < gridRows; ++k) {
-        xCell = k == 0 ? boundingRect.x() + gridCellWidth / 2 : boundingRect.x();
-        yCell = boundingRect.y() + k * gridCellHeight;
-
-        // draw cell background
-        painter.setPen(QPen{});
+        const qreal xCell = k == 0 ? boundingRect.x() + gridCellWidth / 2 : boundingRect.x();
+        const qreal yCell = boundingRect.y() + k * gridCellHeight;
 
-        // draw colored 1.5 cels
+        // colored 1.5 cels
         if (k == 0) {
-            painter.setBrush(QColor{83, 177, 54});
-
             // both cases (i - 0.5) % n
             if (barIndex == 0) { // 0.5 + n.5
-                painter.drawRect(QRectF{xCell,
-                                        boundingRect.y(), gridCellWidth, gridCellHeight});
+                addAbarHighlight(list, QRectF{xCell,
+                                              boundingRect.y(), gridCellWidth, gridCellHeight}, ABAR_HALF_CELL_COLOR);
 
-                painter.drawRect(QRectF{xCell + (gridColumns - 1) * gridCellWidth,
-                                        boundingRect.y(), gridCellWidth, gridCellHeight});
+                addAbarHighlight(list, QRectF{xCell + (gridColumns - 1) * gridCellWidth,
+                                              boundingRect.y(), gridCellWidth, gridCellHeight}, ABAR_HALF_CELL_COLOR);
             } else { // two big
-                painter.drawRect(QRectF{xCell + (barIndex - 1) * gridCellWidth,
-                                        boundingRect.y(), gridCellWidth * 2, gridCellHeight});
+                addAbarHighlight(list, QRectF{xCell + (barIndex - 1) * gridCellWidth,
+                                              boundingRect.y(), gridCellWidth * 2, gridCellHeight}, ABAR_HALF_CELL_COLOR);
             }
         } else { // one colored cell
-            painter.setBrush(QColor{117, 251, 76});
             QRectF rect {xCell + (barIndex) * gridCellWidth, yCell, gridCellWidth, gridCellHeight};
-            painter.drawRect(rect);
+            addAbarHighlight(list, rect, ABAR_LABEL_COLOR);
 
             QRectF textRect = {rect.bottomLeft(), textSize};
             textRect.moveCenter(QPointF{rect.center().x(),  textRect.center().y()});
             textRect.setX(qBound(boundingRect.left(), textRect.x(), boundingRect.right() - textSize.width()));
 
-            painter.setFont(font);
-            painter.setPen(painter.brush().color());
-            painter.drawText(textRect, Qt::AlignHCenter|Qt::AlignTop, str);
-        }
-
-        for (int z = 0; z < gridColumns; ++z) {
-            // draw grid cells
-            painter.setBrush(QBrush{Qt::transparent});
-            painter.setPen(QPen{QBrush{QColor{122, 122, 122}}, penWidth});
-            painter.drawRect(QRectF{xCell, yCell, gridCellWidth, gridCellHeight});
-            xCell += gridCellWidth;
+            list.addText(textRect, Qt::AlignHCenter|Qt::AlignTop, str, glyphs.pixelSize(), labels.color());
         }
     }
+
+    // the lattice is the same for all grids of a pattern and does not depend on the view
+    list.addLattice(boundingRect, gridRows, gridColumns, gridCellHeight, ABAR_GRID_COLOR, penWidth, true, true);
 }
 
-void drawAbarMatrix(QPainter& painter, QRectF boundRect, int barIndex, int barSize)
+void compileAbarMatrix(DisplayList& list, Labels& labels, QRectF boundRect, int barIndex, int barSize)
 {
     const qreal rows = 3;
     const qreal columns = 3;
@@ -319,47 +373,559 @@ void drawAbarMatrix(QPainter& painter, QRectF boundRect, int barIndex, int barSi
             }
 
 
-            drawAbarGrid(painter, gridRect, gridRows, gridColumns, barIndex);
+            compileAbarGrid(list, labels, gridRect, gridRows, gridColumns, barIndex);
             xOffset += matrixRect.width() / (columns - 1);
         }
         yOffset += matrixRect.height() / (rows - 1);
     }
 }
 
-bool makeABarImpl(QImage& image, int rows, int columns)
+bool compileABar(DisplayList& list, const QSize& size, int rows, int columns)
 {
-    image.fill(Qt::black);
-    QPainter painter;
-    if (image.width() <= 0 || image.height() <= 0 || rows <= 0 || columns <= 0 ||
-        !painter.begin(&image)) {
+    if (size.width() <= 0 || size.height() <= 0 || rows <= 0 || columns <= 0) {
         return false;
     }
 
-    const qreal tileHeight = static_cast<qreal>(image.height()) / rows;
-    const qreal tileWidth = static_cast<qreal>(image.width()) / columns;
+    list.setBackground(QColor{Qt::black}.rgba());
+
+    const qreal tileHeight = static_cast<qreal>(size.height()) / rows;
+    const qreal tileWidth = static_cast<qreal>(size.width()) / columns;
 
     qreal xOffset = 0;
     qreal yOffset = 0;
     int value = 0;
+    Labels labels {ABAR_LABEL_COLOR};
 
     for (int i = 0; i < rows; ++i) {
         yOffset = tileHeight * i;
 
         for (int j = 0; j < columns; ++j) {
             xOffset = tileWidth * j;
-            drawAbarMatrix(painter, QRectF{xOffset, yOffset, tileWidth, tileHeight}, value++, rows * columns);
+            compileAbarMatrix(list, labels, QRectF{xOffset, yOffset, tileWidth, tileHeight}, value++, rows * columns);
         }
     }
     return true;
 }
 
-std::vector<QImage> splitImage(const QImage& image, qreal tileWidth, qreal tileHeight, int number)
+//////////////////////////// PATTERN TRAITS
+/**
+ * Compile-time description of a pattern type: its compiler and whether all its
+ * pixels are shades of ACT_PIN_COLOR, so they can be kept as indices of its ramp palette.
+ */
+struct RgbPattern
+{
+    static constexpr bool RAMP_PALETTE = false;
+    static bool compile(DisplayList& list, const QSize& size, int rows, int columns) { return compileRGB(list, size, rows, columns); }
+};
+
+struct ActPattern
+{
+    static constexpr bool RAMP_PALETTE = true;
+    static bool compile(DisplayList& list, const QSize& size, int rows, int columns) { return compileACT(list, size, rows, columns); }
+};
+
+struct AbarPattern
+{
+    static constexpr bool RAMP_PALETTE = false;
+    static bool compile(DisplayList& list, const QSize& size, int rows, int columns) { return compileABar(list, size, rows, columns); }
+};
+
+/**
+ * Calls 'function' with the traits of 'type', the only place a pattern type is resolved at runtime.
+ * @return false for an unknown type
+ */
+template <typename Function>
+bool withPattern(CalibrationFactory::PatternType type, Function&& function)
+{
+    switch (type) {
+        case CalibrationFactory::RGB:
+            function(RgbPattern{});
+            return true;
+
+        case CalibrationFactory::ALIGN_BAR:
+            function(AbarPattern{});
+            return true;
+
+        case CalibrationFactory::ACT:
+            function(ActPattern{});
+            return true;
+    }
+    return false;
+}
+
+using PatternCompiler = bool (*)(DisplayList& list, const QSize& size, int rows, int columns);
+
+PatternCompiler patternCompiler(CalibrationFactory::PatternType type)
+{
+    PatternCompiler compiler = nullptr;
+    withPattern(type, [&](auto pattern) {
+        compiler = decltype(pattern)::compile;
+    });
+    return compiler;
+}
+
+/**
+ * Ramp palettes are written by the raster kernels only, QPainter cannot paint indices.
+ */
+bool usesRampPalette(CalibrationFactory::PatternType type)
+{
+    bool ramp = false;
+    withPattern(type, [&](auto pattern) {
+        ramp = decltype(pattern)::RAMP_PALETTE;
+    });
+    return ramp && fastRasterEnabled;
+}
+
+// canvases of a session are few: the image size and the strip of its views
+const int MAX_DISPLAY_LISTS = 16;
+
+using DisplayListKey = std::tuple<int, int, int, int, int>;
+std::mutex displayListsMutex;
+std::map<DisplayListKey, std::shared_ptr<const DisplayList>> displayLists;
+
+/**
+ * Provides the list of a pattern laid out for 'size', compiled once and shared by
+ * every view, band and thread rendering that canvas.
+ */
+std::shared_ptr<const DisplayList> displayList(CalibrationFactory::PatternType type, const QSize& size, int rows, int columns)
+{
+    const PatternCompiler compiler = patternCompiler(type);
+    if (!compiler) {
+        return nullptr;
+    }
+
+    const DisplayListKey key {type, size.width(), size.height(), rows, columns};
+
+    // compiled under the lock, so views starting together do not compile the same list
+    std::lock_guard<std::mutex> lock {displayListsMutex};
+    const auto it = displayLists.find(key);
+    if (it != displayLists.end()) {
+        return it->second;
+    }
+
+    Profiler::Scope scope {"compile"};
+    auto list = std::make_shared<DisplayList>();
+    list->setFontFamily(LABEL_FONT_FAMILY);
+    if (!compiler(*list, size, rows, columns)) {
+        return nullptr;
+    }
+
+    if (static_cast<int>(displayLists.size()) >= MAX_DISPLAY_LISTS) {
+        displayLists.clear();
+    }
+    displayLists.emplace(key, list);
+    return list;
+}
+
+/**
+ * Replays the part of 'list' the image covers: straight into scanlines when the
+ * list and image format allow it, with a painter otherwise.
+ */
+bool replayList(QImage& image, const Viewport& viewport, const DisplayList& list,
+                DisplayList::Layer layer = DisplayList::ALL_OPS)
+{
+    if (image.isNull()) {
+        return false;
+    }
+
+    const QRectF visibleRect {viewport.origin, image.size()};
+    if (fastRasterEnabled && list.isRasterizable() && RasterKernels::withPixels(image.format(), [&](auto pixels) {
+            RasterBackend<decltype(pixels)> backend {image, viewport.origin};
+            list.replay(backend, visibleRect, layer);
+        })) {
+        return true;
+    }
+
+    QPainter painter;
+    if (!painter.begin(&image)) {
+        return false;
+    }
+    painter.translate(-viewport.origin);
+
+    PainterBackend::Options options;
+    options.glyphAtlas = glyphAtlasEnabled;
+    PainterBackend backend {painter, options};
+    list.replay(backend, visibleRect, layer);
+    return true;
+}
+
+/**
+ * Transparent background is transparent in 32-bit formats, black in opaque ones
+ * and index 0 in indexed ones.
+ */
+void fillBackground(QImage& image, const DisplayList& list)
 {
-    std::vector<QImage> result;
+    Profiler::Scope scope {"fill"};
+    if (qAlpha(list.background()) == 0) {
+        image.fill(0);
+    } else {
+        image.fill(QColor::fromRgba(list.background()));
+    }
+}
+
+// bands thinner than this spend more time on culling than on painting
+const int MIN_BAND_HEIGHT = 64;
+const int BANDS_PER_THREAD = 4;
+
+/**
+ * Splits the image into horizontal bands sharing its memory and replays the list
+ * into them concurrently, each band with its own backend clipped by the band bounds.
+ */
+bool renderBands(QImage& image, const Viewport& viewport, const DisplayList& list)
+{
+    Profiler::Scope scope {"paint"};
+    auto& pool = WorkerPool::shared();
+    const int bandCount = qBound(1, image.height() / MIN_BAND_HEIGHT, pool.threadCount() * BANDS_PER_THREAD);
+    if (bandCount == 1 || image.isNull()) {
+        return replayList(image, viewport, list);
+    }
+
+    const int bandHeight = (image.height() + bandCount - 1) / bandCount;
+    const int bytesPerLine = image.bytesPerLine();
+    uchar* bits = image.bits();
+    std::atomic<bool> failed {false};
+
+    pool.run(bandCount, [&](int i) {
+        const int top = i * bandHeight;
+        const int height = qMin(bandHeight, image.height() - top);
+        if (height <= 0) {
+            return;
+        }
+
+        Profiler::Scope bandScope {"band", i};
+        QImage band {bits + top * bytesPerLine, image.width(), height, bytesPerLine, image.format()};
+        if (!replayList(band, Viewport{viewport.size, viewport.origin + QPoint{0, top}}, list)) {
+            failed = true;
+        }
+    });
+    return !failed;
+}
+
+/**
+ * Renders the part of a pattern laid out for 'viewport.size' which the image covers.
+ */
+bool renderRegion(QImage& image, CalibrationFactory::PatternType type, const Viewport& viewport, int rows, int columns)
+{
+    const auto list = displayList(type, viewport.size, rows, columns);
+    if (!list) {
+        return false;
+    }
+
+    fillBackground(image, *list);
+    return renderBands(image, viewport, *list);
+}
+
+//////////////////////////// VIEW DELTAS
+// patching more than this fraction of a view costs more than painting it whole
+const qreal MAX_PATCHED_FRACTION = 0.5;
+// a set needs a base per distinct sub-pixel phase of its grid, at most one per view
+const int MIN_VIEW_BASES = 8;
+const int MAX_VIEW_BASES = 64;
+const qint64 MAX_VIEW_BASE_BYTES = 256 << 20;
+
+/**
+ * Background and invariant ops of a view, rendered once for every view they match.
+ */
+struct ViewBase
+{
+    std::shared_ptr<const DisplayList> list; // keeps the list, and so its address, alive
+    std::vector<DisplayList::Op> ops;        // invariant ops in view coordinates
+    QImage image;                            // of the view format and stride
+};
+
+std::mutex viewBasesMutex;
+std::vector<ViewBase> viewBases;
+
+bool matches(const ViewBase& base, const std::shared_ptr<const DisplayList>& list, const QImage& view,
+             const std::vector<DisplayList::Op>& ops)
+{
+    return base.list == list && base.image.size() == view.size() && base.image.format() == view.format() &&
+           base.image.bytesPerLine() == view.bytesPerLine() && base.ops == ops;
+}
+
+/**
+ * Image owning its pixels with the stride of 'view', which may wrap a caller buffer,
+ * so the base is copied into the view as a single block.
+ */
+QImage imageLike(const QImage& view)
+{
+    const qint64 size = static_cast<qint64>(view.bytesPerLine()) * view.height();
+    auto* data = new uchar[static_cast<size_t>(size)];
+    QImage image {data, view.width(), view.height(), view.bytesPerLine(), view.format(),
+                  [](void* pixels) { delete[] static_cast<uchar*>(pixels); }, data};
+    image.setColorTable(view.colorTable());
+    return image;
+}
+
+/**
+ * Provides the base of the view, shared by views whose invariant ops land on the
+ * same view pixels. Ops are compared after translation into the view, so a grid
+ * drifting by a sub-pixel amount between views gets a base of its own; the cache
+ * keeps a base for each of the 'number' views of the set, as far as MAX_VIEW_BASES
+ * and MAX_VIEW_BASE_BYTES allow.
+ */
+QImage viewBase(const std::shared_ptr<const DisplayList>& list, const QImage& view, const Viewport& viewport, int number)
+{
+    auto ops = list->collect(QRectF{viewport.origin, view.size()}, DisplayList::INVARIANT_OPS);
+    for (auto& op : ops) {
+        op.rect.translate(-viewport.origin);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock {viewBasesMutex};
+        for (const auto& base : viewBases) {
+            if (matches(base, list, view, ops)) {
+                return base.image;
+            }
+        }
+    }
+
+    // rendered without the lock, views needing other bases do not wait for this one
+    Profiler::Scope scope {"view base"};
+    QImage image = imageLike(view);
+    fillBackground(image, *list);
+    if (!replayList(image, viewport, *list, DisplayList::INVARIANT_OPS)) {
+        return {};
+    }
+
+    std::lock_guard<std::mutex> lock {viewBasesMutex};
+    for (const auto& base : viewBases) {
+        if (matches(base, list, view, ops)) {
+            return base.image; // published by a view rendering the same base meanwhile
+        }
+    }
+
+    const qint64 affordable = qMax<qint64>(1, MAX_VIEW_BASE_BYTES / qMax<qint64>(1, image.sizeInBytes()));
+    const int capacity = static_cast<int>(qMin<qint64>(qBound(MIN_VIEW_BASES, number, MAX_VIEW_BASES), affordable));
+    while (static_cast<int>(viewBases.size()) >= capacity) {
+        viewBases.erase(viewBases.begin());
+    }
+    viewBases.push_back({list, std::move(ops), image});
+    return image;
+}
+
+/**
+ * Renders a view as a copy of its base with the areas of variant ops patched in:
+ * every patch is cleared to the background and all ops touching it are replayed
+ * clipped by it, so the result matches a full render of the view.
+ *
+ * @return false without touching the view if patches would cover too much of it
+ */
+bool renderDelta(QImage& view, const Viewport& viewport, const std::shared_ptr<const DisplayList>& list, int number)
+{
+    std::vector<QRect> patches;
+    qint64 patchedArea = 0;
+    for (const auto& op : list->collect(QRectF{viewport.origin, view.size()}, DisplayList::VARIANT_OPS)) {
+        const QRect patch = op.bounds().translated(-viewport.origin).toAlignedRect() & view.rect();
+        patches.push_back(patch);
+        patchedArea += static_cast<qint64>(patch.width()) * patch.height();
+    }
+
+    if (patchedArea > MAX_PATCHED_FRACTION * view.width() * view.height()) {
+        return false;
+    }
+
+    const QImage base = viewBase(list, view, viewport, number);
+    if (base.isNull()) {
+        return false;
+    }
+
+    Profiler::Scope scope {"delta"};
+    Q_ASSERT(base.format() == view.format() && base.bytesPerLine() == view.bytesPerLine());
+    std::memcpy(view.bits(), base.constBits(), static_cast<size_t>(base.bytesPerLine()) * base.height());
+
+    QPainter painter;
+    if (!painter.begin(&view)) {
+        return false;
+    }
+
+    PainterBackend::Options options;
+    options.glyphAtlas = glyphAtlasEnabled;
+    PainterBackend backend {painter, options};
+    const QColor background = QColor::fromRgba(list->background());
+
+    for (const QRect& patch : patches) {
+        painter.resetTransform();
+        painter.setClipRect(patch);
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        painter.fillRect(patch, background);
+        painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+
+        painter.translate(-viewport.origin);
+        list->replay(backend, QRectF{patch.translated(viewport.origin)});
+    }
+    return true;
+}
+
+bool canRender(CalibrationFactory::PatternType type, const QImage& image)
+{
+    switch (image.format()) {
+        case QImage::Format_Invalid:
+        case QImage::Format_Mono:
+        case QImage::Format_MonoLSB:
+            return false;
+
+        case QImage::Format_Indexed8:
+            return usesRampPalette(type);
+
+        default:
+            return !image.isNull();
+    }
+}
+
+QVector<QRgb> colorTable(QImage::Format format)
+{
+    if (format == QImage::Format_Indexed8) {
+        return RasterKernels::rampColorTable(ACT_PIN_COLOR);
+    }
+    return {};
+}
+
+void setPalette(QImage& image)
+{
+    if (image.format() == QImage::Format_Indexed8 && image.colorTable().isEmpty()) {
+        image.setColorTable(colorTable(image.format()));
+    }
+}
+
+std::vector<int> allViews(int number)
+{
+    std::vector<int> indices(static_cast<size_t>(qMax(number, 0)));
     for (int i = 0; i < number; ++i) {
-        result.emplace_back(image.copy(tileWidth * i, 0, tileWidth, tileHeight));
+        indices[i] = i;
     }
-    return result;
+    return indices;
+}
+
+bool isViewSubset(int number, const std::vector<int>& indices)
+{
+    return std::all_of(indices.begin(), indices.end(), [number](int i) { return i >= 0 && i < number; });
+}
+
+/**
+ * Allocates an image of the format patterns of 'type' are rendered into, along with
+ * the palette of indexed formats.
+ */
+QImage createImage(CalibrationFactory::PatternType type, int width, int height)
+{
+    Profiler::Scope scope {"allocate"};
+    QImage image {width, height, CalibrationFactory::patternFormat(type)};
+    setPalette(image);
+    return image;
+}
+
+
+/**
+ * Replays the pattern into a vector document: glyphs stay text and repeated
+ * primitives stay shapes rather than blits of raster stamps.
+ */
+bool saveVector(CalibrationFactory::PatternType type, const QString& filePath, int imageWidth, int imageHeight, int rows, int columns)
+{
+    const auto list = displayList(type, QSize{imageWidth, imageHeight}, rows, columns);
+    QSaveFile file {filePath};
+    if (!list || !file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    Profiler::Scope scope {"save"};
+    const QRectF canvas {0, 0, static_cast<qreal>(imageWidth), static_cast<qreal>(imageHeight)};
+    const auto replay = [&](QPaintDevice& device) {
+        QPainter painter;
+        if (!painter.begin(&device)) {
+            return false;
+        }
+
+        if (qAlpha(list->background()) != 0) {
+            painter.fillRect(canvas, QColor::fromRgba(list->background()));
+        }
+
+        PainterBackend::Options options;
+        options.glyphAtlas = false;
+        options.stamps = false;
+        PainterBackend backend {painter, options};
+        list->replay(backend, canvas);
+        return painter.end();
+    };
+
+    bool ok = false;
+    if (QFileInfo{filePath}.suffix().compare("svg", Qt::CaseInsensitive) == 0) {
+        QSvgGenerator generator;
+        generator.setOutputDevice(&file);
+        generator.setSize(QSize{imageWidth, imageHeight});
+        generator.setViewBox(canvas);
+        ok = replay(generator);
+    } else {
+        // one point per pattern pixel
+        QPdfWriter writer {&file};
+        writer.setResolution(72);
+        writer.setPageLayout(QPageLayout{QPageSize{canvas.size(), QPageSize::Point}, QPageLayout::Portrait, QMarginsF{0, 0, 0, 0}});
+        ok = replay(writer);
+    }
+    return ok && file.commit();
+}
+
+bool isVectorPath(const QString& filePath)
+{
+    const QString suffix = QFileInfo{filePath}.suffix();
+    return suffix.compare("svg", Qt::CaseInsensitive) == 0 || suffix.compare("pdf", Qt::CaseInsensitive) == 0;
+}
+
+bool savePattern(CalibrationFactory::PatternType type, const QString& filePath, int imageWidth, int imageHeight, int rows, int columns)
+{
+    if (isVectorPath(filePath)) {
+        return saveVector(type, filePath, imageWidth, imageHeight, rows, columns);
+    }
+
+    QImage image = createImage(type, imageWidth, imageHeight);
+    if (!renderRegion(image, type, Viewport::whole(image), rows, columns)) {
+        return false;
+    }
+
+    Profiler::Scope scope {"save"};
+    return ImageEncoder::save(image, filePath, encoderSettings);
+}
+
+//////////////////////////// PYRAMID
+
+/**
+ * Pixel size of the smallest label of the pattern laid out for 'size', 0 if it has none.
+ */
+int smallestLabel(CalibrationFactory::PatternType type, const QSize& size, int rows, int columns)
+{
+    const auto list = displayList(type, size, rows, columns);
+    if (!list) {
+        return 0;
+    }
+
+    int pixelSize = 0;
+    for (const auto& op : list->ops()) {
+        if (op.type == DisplayList::TEXT && (pixelSize == 0 || op.pixelSize < pixelSize)) {
+            pixelSize = op.pixelSize;
+        }
+    }
+    return pixelSize;
+}
+
+/**
+ * Averages 'factor' x 'factor' blocks of 'source' into 'target', bands of target rows
+ * run concurrently.
+ */
+void downsample(const QImage& source, QImage& target, int factor)
+{
+    Profiler::Scope scope {"downsample"};
+    const int bandCount = (target.height() + MIN_BAND_HEIGHT - 1) / MIN_BAND_HEIGHT;
+    const int bytesPerPixel = source.depth() / 8;
+    const uchar* sourceBits = source.constBits();
+    uchar* targetBits = target.bits();
+
+    WorkerPool::shared().run(bandCount, [&](int band) {
+        const int last = qMin(target.height(), (band + 1) * MIN_BAND_HEIGHT);
+        for (int y = band * MIN_BAND_HEIGHT; y < last; ++y) {
+            RasterKernels::boxDownsampleRow(targetBits + static_cast<qint64>(y) * target.bytesPerLine(),
+                                            sourceBits + static_cast<qint64>(y) * factor * source.bytesPerLine(),
+                                            source.bytesPerLine(), target.width(), bytesPerPixel, factor);
+        }
+    });
 }
 
 } // namespace
@@ -367,53 +933,337 @@ std::vector<QImage> splitImage(const QImage& image, qreal tileWidth, qreal tileH
 
 bool CalibrationFactory::makeRGB(const QString &filePath, int imageWidth, int imageHeight, int rows, int columns)
 {
-    QImage image {imageWidth, imageHeight,  QImage::Format_ARGB32};
-    image.fill(Qt::transparent);
-    if (!makeRGBImpl(image, rows, columns)) {
+    return savePattern(RGB, filePath, imageWidth, imageHeight, rows, columns);
+}
+
+bool CalibrationFactory::makeACT(const QString &filePath, int imageWidth, int imageHeight, int rows, int columns)
+{
+    return savePattern(ACT, filePath, imageWidth, imageHeight, rows, columns);
+}
+
+bool CalibrationFactory::makeABar(const QString &filePath, int imageWidth, int imageHeight, int rows, int columns)
+{
+    return savePattern(ALIGN_BAR, filePath, imageWidth, imageHeight, rows, columns);
+}
+
+bool CalibrationFactory::makePattern(CalibrationFactory::PatternType type, const QString &filePath, int imageWidth, int imageHeight, int rows, int columns)
+{
+    return savePattern(type, filePath, imageWidth, imageHeight, rows, columns);
+}
+
+bool CalibrationFactory::makePyramid(CalibrationFactory::PatternType type, const QString& filePath, int imageWidth, int imageHeight,
+                                     int rows, int columns, const std::vector<PyramidLevel>& levels, int minLabelPixels)
+{
+    if (imageWidth <= 0 || imageHeight <= 0 || isVectorPath(filePath) || !RasterKernels::supportsDownsampling(patternFormat(type))) {
+        return false;
+    }
+
+    for (const auto& level : levels) {
+        if (level.factor < 2 || level.factor > RasterKernels::MAX_DOWNSAMPLE_FACTOR ||
+            imageWidth % level.factor != 0 || imageHeight % level.factor != 0 || isVectorPath(level.filePath)) {
+            return false;
+        }
+    }
+
+    QImage master = createImage(type, imageWidth, imageHeight);
+    if (!renderRegion(master, type, Viewport::whole(master), rows, columns)) {
+        return false;
+    }
+
+    {
+        Profiler::Scope scope {"save"};
+        if (!ImageEncoder::save(master, filePath, encoderSettings)) {
+            return false;
+        }
+    }
+
+    // a level shrinking the smallest label below minLabelPixels is laid out and painted
+    // at its own size, so its labels get a font size of their own
+    const int labelPixels = minLabelPixels > 0 ? smallestLabel(type, master.size(), rows, columns) : 0;
+    for (const auto& level : levels) {
+        QImage image = createImage(type, imageWidth / level.factor, imageHeight / level.factor);
+        if (labelPixels > 0 && labelPixels < minLabelPixels * level.factor) {
+            if (!renderRegion(image, type, Viewport::whole(image), rows, columns)) {
+                return false;
+            }
+        } else {
+            downsample(master, image, level.factor);
+        }
+
+        Profiler::Scope scope {"save", level.factor};
+        if (!ImageEncoder::save(image, level.filePath, encoderSettings)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CalibrationFactory::renderPattern(CalibrationFactory::PatternType type, QImage& image, int rows, int columns)
+{
+    if (!canRender(type, image)) {
         return false;
     }
-    return image.save(filePath);
+
+    setPalette(image);
+    return renderRegion(image, type, Viewport::whole(image), rows, columns);
 }
 
-bool CalibrationFactory::makeACT(const QString &filePath, int imageWidth, int imageHeight, int rows, int columns)
+bool CalibrationFactory::renderPattern(CalibrationFactory::PatternType type, uchar* data, int width, int height, int bytesPerLine,
+                                       QImage::Format format, int rows, int columns)
 {
-    QImage image {imageWidth, imageHeight,  QImage::Format_ARGB32};
-    image.fill(Qt::transparent);
-    if (!makeACTImpl(image, rows, columns)) {
+    if (!data || width <= 0 || height <= 0) {
         return false;
     }
-    return image.save(filePath);
+
+    QImage image {data, width, height, bytesPerLine, format};
+    return renderPattern(type, image, rows, columns);
 }
 
-bool CalibrationFactory::makeABar(const QString &filePath, int imageWidth, int imageHeight, int rows, int columns)
+bool CalibrationFactory::renderView(CalibrationFactory::PatternType type, QImage& view, int number, int index)
 {
-    QImage image {imageWidth, imageHeight,  QImage::Format_ARGB32};
-    if (!makeABarImpl(image, rows, columns)) {
+    if (number <= 0 || index < 0 || index >= number || !canRender(type, view)) {
         return false;
     }
-    return image.save(filePath);
+
+    Profiler::Scope scope {"view", index};
+
+    // views are the tiles of a 'number' x 1 pattern of 'width * number' x 'height' size,
+    // the view is rendered straight into its buffer through a view-local viewport
+    setPalette(view);
+    const Viewport viewport {QSize{view.width() * number, view.height()}, QPoint{view.width() * index, 0}};
+
+    // views of a set differ in a few spots only, they are patched into a shared base
+    if (viewDeltasEnabled && number > 1) {
+        const auto list = displayList(type, viewport.size, 1, number);
+        if (list && list->hasInvariantOps() && renderDelta(view, viewport, list, number)) {
+            return true;
+        }
+    }
+    return renderRegion(view, type, viewport, 1, number);
 }
 
-bool CalibrationFactory::makePattern(CalibrationFactory::PatternType type, const QString &filePath, int imageWidth, int imageHeight, int rows, int columns)
+bool CalibrationFactory::renderView(CalibrationFactory::PatternType type, uchar* data, int width, int height, int bytesPerLine,
+                                    QImage::Format format, int number, int index)
 {
-    QImage image {imageWidth, imageHeight,  QImage::Format_ARGB32};
-    image.fill(Qt::transparent);
+    if (!data || width <= 0 || height <= 0) {
+        return false;
+    }
 
-    bool result{false};
-    switch (type)
-    {
-    case CalibrationFactory::RGB:
-        result = makeRGBImpl(image, rows, columns);
-        break;
-    case CalibrationFactory::ACT:
-        result = makeACTImpl(image, rows, columns);
-        break;
-    case CalibrationFactory::ALIGN_BAR:
-        result = makeABarImpl(image, rows, columns);
-        break;
+    QImage view {data, width, height, bytesPerLine, format};
+    return renderView(type, view, number, index);
+}
+
+bool CalibrationFactory::makePatternStreamed(CalibrationFactory::PatternType type, const QString& filePath, int imageWidth, int imageHeight,
+                                             int rows, int columns, int bandHeight)
+{
+    if (imageWidth <= 0 || imageHeight <= 0 || bandHeight <= 0) {
+        return false;
+    }
+
+    ImageEncoder::Backend backend = ImageEncoder::AUTO;
+    const QString suffix = QFileInfo{filePath}.suffix();
+    if (!ImageEncoder::resolve(encoderSettings.backend, suffix, backend, true) || !ImageEncoder::isStreaming(backend)) {
+        return false;
+    }
+
+    QSaveFile file {filePath};
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
     }
 
-    return result && image.save(filePath);
+    // one band buffer is reused, the last band only uses its first rows
+    QImage buffer = createImage(type, imageWidth, qMin(bandHeight, imageHeight));
+    const QImage::Format format = buffer.format();
+    const auto encoder = ImageEncoder::create(encoderSettings, suffix, &file, true);
+    if (!encoder || !encoder->begin(imageWidth, imageHeight, format, buffer.colorTable())) {
+        return false;
+    }
+
+    const Viewport canvas {QSize{imageWidth, imageHeight}, QPoint{0, 0}};
+    for (int top = 0; top < imageHeight; top += buffer.height()) {
+        const int height = qMin(buffer.height(), imageHeight - top);
+        QImage band {buffer.bits(), imageWidth, height, buffer.bytesPerLine(), format};
+
+        if (!renderRegion(band, type, Viewport{canvas.size, QPoint{0, top}}, rows, columns)) {
+            return false;
+        }
+
+        Profiler::Scope scope {"encode", top / buffer.height()};
+        if (!encoder->writeRows(band)) {
+            return false;
+        }
+    }
+
+    Profiler::Scope scope {"finish"};
+    return encoder->finish() && file.commit();
+}
+
+bool CalibrationFactory::makePatternMapped(CalibrationFactory::PatternType type, const QString& filePath, int imageWidth, int imageHeight,
+                                           int rows, int columns, bool sync)
+{
+    const QImage::Format format = MappedImage::fileFormat(filePath, patternFormat(type));
+    MappedImage file {filePath};
+    return file.create(imageWidth, imageHeight, format, colorTable(format)) &&
+           renderPattern(type, file.image(), rows, columns) && file.finish(sync);
+}
+
+bool CalibrationFactory::makeViewsMapped(CalibrationFactory::PatternType type, const std::function<QString(int index)>& fileName,
+                                         int width, int height, int number, bool sync)
+{
+    return makeViewsMapped(type, fileName, width, height, number, allViews(number), sync);
+}
+
+bool CalibrationFactory::makeViewsMapped(CalibrationFactory::PatternType type, const std::function<QString(int index)>& fileName,
+                                         int width, int height, int number, const std::vector<int>& indices, bool sync)
+{
+    if (width <= 0 || height <= 0 || number <= 0 || !isViewSubset(number, indices)) {
+        return false;
+    }
+
+    // every view is its own mapped file, workers render straight into them
+    std::atomic<bool> failed {false};
+    WorkerPool::shared().run(static_cast<int>(indices.size()), [&](int task) {
+        if (failed) {
+            return;
+        }
+
+        const int i = indices[task];
+
+        const QString filePath = fileName(i);
+        const QImage::Format format = MappedImage::fileFormat(filePath, patternFormat(type));
+        MappedImage file {filePath};
+        if (!file.create(width, height, format, colorTable(format)) || !renderView(type, file.image(), number, i) ||
+            !file.finish(sync)) {
+            failed = true;
+        }
+    });
+    return !failed;
+}
+
+bool CalibrationFactory::interleave(CalibrationFactory::PatternType type, const Interleaver& interleaver, QImage& composite)
+{
+    if (!interleaver.isValid() || composite.size() != interleaver.size() || composite.format() != QImage::Format_RGB888) {
+        return false;
+    }
+
+    const QSize size = interleaver.size();
+    const int number = interleaver.views();
+    const Viewport views {QSize{size.width() * number, size.height()}, QPoint{0, 0}};
+    const auto list = displayList(type, views.size, 1, number);
+    if (!list) {
+        return false;
+    }
+
+    // every band of the composite is owned by one worker, which renders that band of
+    // each view in turn and merges it, so no two workers ever write the same rows
+    auto& pool = WorkerPool::shared();
+    const int bandCount = qBound(1, size.height() / MIN_BAND_HEIGHT, pool.threadCount() * BANDS_PER_THREAD);
+    const int bandHeight = (size.height() + bandCount - 1) / bandCount;
+    std::atomic<bool> failed {false};
+
+    pool.run(bandCount, [&](int band) {
+        const int top = band * bandHeight;
+        const int height = qMin(bandHeight, size.height() - top);
+        if (height <= 0) {
+            return;
+        }
+
+        Profiler::Scope scope {"interleave", band};
+        QImage buffer = createImage(type, size.width(), height);
+        for (int i = 0; i < number && !failed; ++i) {
+            fillBackground(buffer, *list);
+            if (!replayList(buffer, Viewport{views.size, QPoint{size.width() * i, top}}, *list)) {
+                failed = true;
+                return;
+            }
+
+            const QImage rgb = buffer.format() == QImage::Format_RGB888 ? buffer : buffer.convertToFormat(QImage::Format_RGB888);
+            if (!interleaver.addRows(composite, rgb, i, top)) {
+                failed = true;
+            }
+        }
+    });
+    return !failed;
+}
+
+bool CalibrationFactory::makeInterleaved(CalibrationFactory::PatternType type, const QString& filePath, const Interleaver& interleaver)
+{
+    if (!interleaver.isValid()) {
+        return false;
+    }
+
+    QImage composite {interleaver.size(), QImage::Format_RGB888};
+    if (!interleave(type, interleaver, composite)) {
+        return false;
+    }
+
+    Profiler::Scope scope {"save"};
+    return ImageEncoder::save(composite, filePath, encoderSettings);
+}
+
+QImage::Format CalibrationFactory::patternFormat(CalibrationFactory::PatternType type)
+{
+    if (!compactFormatsEnabled) {
+        return QImage::Format_ARGB32;
+    }
+
+    // every pattern is opaque and ACT has nothing but shades of green, which the
+    // raster kernels write as indices of a green ramp palette
+    if (usesRampPalette(type)) {
+        return QImage::Format_Indexed8;
+    }
+    return QImage::Format_RGB888;
+}
+
+QString CalibrationFactory::generatorVersion()
+{
+    // bump GENERATOR_REVISION whenever rendering of any pattern changes
+    return QString{"%1;raster=%2;atlas=%3;stamps=%4;compact=%5"}
+            .arg(GENERATOR_REVISION)
+            .arg(fastRasterEnabled ? 1 : 0)
+            .arg(glyphAtlasEnabled ? 1 : 0)
+            .arg(StampCache::isEnabled() ? 1 : 0)
+            .arg(compactFormatsEnabled ? 1 : 0);
+}
+
+void CalibrationFactory::setThreadCount(int threadCount)
+{
+    WorkerPool::setSharedThreadCount(threadCount);
+}
+
+void CalibrationFactory::setFastRasterEnabled(bool enabled)
+{
+    fastRasterEnabled = enabled;
+}
+
+void CalibrationFactory::setGlyphAtlasEnabled(bool enabled)
+{
+    glyphAtlasEnabled = enabled;
+}
+
+void CalibrationFactory::setStampCacheEnabled(bool enabled)
+{
+    StampCache::setEnabled(enabled);
+}
+
+void CalibrationFactory::setCompactFormatsEnabled(bool enabled)
+{
+    compactFormatsEnabled = enabled;
+}
+
+void CalibrationFactory::setViewDeltasEnabled(bool enabled)
+{
+    viewDeltasEnabled = enabled;
+}
+
+void CalibrationFactory::setEncoder(const ImageEncoder::Settings& settings)
+{
+    encoderSettings = settings;
+}
+
+ImageEncoder::Settings CalibrationFactory::encoder()
+{
+    return encoderSettings;
 }
 
 std::vector<QImage> CalibrationFactory::getPattern(CalibrationFactory::PatternType type, int width, int height, int number)
@@ -422,23 +1272,68 @@ std::vector<QImage> CalibrationFactory::getPattern(CalibrationFactory::PatternTy
         return {};
     }
 
-    QImage image {width * number, height,  QImage::Format_ARGB32};
-    image.fill(Qt::transparent);
-    switch (type) {
-        case CalibrationFactory::RGB:
-            makeRGBImpl(image, 1, number);
-            break;
+    // every worker paints its own view with its own painter, results keep index order
+    std::vector<QImage> result(number);
+    std::atomic<bool> failed {false};
+    WorkerPool::shared().run(number, [&](int i) {
+        QImage view = createImage(type, width, height);
+        if (!renderView(type, view, number, i)) {
+            failed = true;
+        }
+        result[i] = std::move(view);
+    });
 
-        case CalibrationFactory::ALIGN_BAR:
-            makeABarImpl(image, 1, number);
-            break;
+    if (failed) {
+        return {};
+    }
+    return result;
+}
 
-        case CalibrationFactory::ACT:
-            makeACTImpl(image, 1, number);
-            break;
+bool CalibrationFactory::forEachView(CalibrationFactory::PatternType type, int width, int height, int number,
+                                     const ViewCallback& callback)
+{
+    return forEachView(type, width, height, number, allViews(number), callback);
+}
 
-        default: return {};
+bool CalibrationFactory::forEachView(CalibrationFactory::PatternType type, int width, int height, int number,
+                                     const std::vector<int>& indices, const ViewCallback& callback)
+{
+    if (width <= 0 || height <= 0 || number <= 0 || !isViewSubset(number, indices)) {
+        return false;
     }
 
-    return splitImage(image, width, height, number);
+    // view buffers are reused by workers unless the callback keeps a copy of the view
+    std::mutex buffersMutex;
+    std::vector<QImage> buffers;
+    std::atomic<bool> failed {false};
+
+    WorkerPool::shared().run(static_cast<int>(indices.size()), [&](int task) {
+        if (failed) {
+            return;
+        }
+
+        const int i = indices[task];
+        QImage view;
+        {
+            std::lock_guard<std::mutex> lock {buffersMutex};
+            if (!buffers.empty()) {
+                view = std::move(buffers.back());
+                buffers.pop_back();
+            }
+        }
+
+        // a buffer still shared with the callback's copy is replaced rather than detached
+        if (view.isNull() || !view.isDetached()) {
+            view = createImage(type, width, height);
+        }
+
+        if (!renderView(type, view, number, i) || !callback(i, view)) {
+            failed = true;
+        }
+
+        std::lock_guard<std::mutex> lock {buffersMutex};
+        buffers.push_back(std::move(view));
+    });
+
+    return !failed;
 }
@@ -1,10 +1,14 @@
 #pragma once
 
+#include <functional>
 #include <vector>
 
 #include <QImage>
 #include <QString>
 
+#include "ImageEncoder.h"
+#include "Interleaver.h"
+
 struct CalibrationFactory
 {
     enum PatternType
@@ -17,8 +21,169 @@ struct CalibrationFactory
     static bool makeRGB(const QString& filePath, int imageWidth, int imageHeight, int rows, int columns);
     static bool makeACT(const QString& filePath, int imageWidth, int imageHeight, int rows, int columns);
     static bool makeABar(const QString& filePath, int imageWidth, int imageHeight, int rows, int columns);
+
+    /**
+     * @brief makePattern - renders pattern and saves it to 'filePath', a ".svg" or ".pdf"
+     *                      path gets a vector document of 'imageWidth' x 'imageHeight' units
+     */
     static bool makePattern(PatternType type, const QString& filePath, int imageWidth, int imageHeight, int rows, int columns);
 
+    /**
+     * @brief renderPattern - renders 'rows' x 'columns' pattern over the whole 'image' in place,
+     *                        so the same image can be reused for every frame. Keep the image
+     *                        unshared, otherwise it is detached before rendering
+     * @param image - target of any format QPainter paints on, Indexed8 is supported for ACT
+     *                rendered by the raster kernels and gets the green palette if it has none
+     * @return false if the image can not be rendered in its format
+     */
+    static bool renderPattern(PatternType type, QImage& image, int rows, int columns);
+
+    /**
+     * @brief renderPattern - renders pattern into caller's memory, nothing is allocated for pixels
+     * @param data - first scanline of 'width' x 'height' pixels of 'format'
+     * @param bytesPerLine - stride between scanlines, 'data' has to be 32-bit aligned
+     */
+    static bool renderPattern(PatternType type, uchar* data, int width, int height, int bytesPerLine,
+                              QImage::Format format, int rows, int columns);
+
+    /**
+     * @brief renderView - renders view 'index' of the 'number' views provided by getPattern
+     *                     into 'view' in place, other views are not rendered at all
+     * @return false if index is out of range or the view can not be rendered in its format
+     */
+    static bool renderView(PatternType type, QImage& view, int number, int index);
+
+    /**
+     * @brief renderView - renders single view into caller's memory, see renderPattern
+     */
+    static bool renderView(PatternType type, uchar* data, int width, int height, int bytesPerLine,
+                           QImage::Format format, int number, int index);
+
+    struct PyramidLevel
+    {
+        int factor = 2; // master width and height divided by
+        QString filePath;
+    };
+
+    /**
+     * @brief makePyramid - renders the pattern once at 'imageWidth' x 'imageHeight' into 'filePath'
+     *                      and derives every smaller level from it by box downsampling
+     * @param levels - factors have to divide both master dimensions
+     * @param minLabelPixels - a level whose smallest label would be scaled below this pixel
+     *                         size is rendered natively instead, 0 - always downsample
+     */
+    static bool makePyramid(PatternType type, const QString& filePath, int imageWidth, int imageHeight, int rows, int columns,
+                            const std::vector<PyramidLevel>& levels, int minLabelPixels = 0);
+
+    /**
+     * @brief makePatternStreamed - renders pattern in horizontal bands and encodes each band
+     *                              into the file as soon as it is ready, so memory needed
+     *                              is proportional to image width, not to its size
+     * @param bandHeight - number of rows rendered at once
+     * @return true if the file was written completely, false if the encoder does not stream
+     */
+    static bool makePatternStreamed(PatternType type, const QString& filePath, int imageWidth, int imageHeight,
+                                    int rows, int columns, int bandHeight = 256);
+
+    /**
+     * @brief makePatternMapped - renders pattern straight into the memory mapped file, a raw,
+     *                            PPM, PGM or BMP one, see MappedImage. Nothing is encoded or copied
+     * @param sync - flushes the file to the disk before returning
+     * @return false if the file type can not be mapped
+     */
+    static bool makePatternMapped(PatternType type, const QString& filePath, int imageWidth, int imageHeight,
+                                  int rows, int columns, bool sync);
+
+    /**
+     * @brief makeViewsMapped - renders 'number' views in parallel, each one straight into its
+     *                          memory mapped file named by 'fileName', see makePatternMapped
+     */
+    static bool makeViewsMapped(PatternType type, const std::function<QString(int index)>& fileName,
+                                int width, int height, int number, bool sync);
+
+    /**
+     * @brief makeViewsMapped - renders only the views of 'number' listed in 'indices'
+     */
+    static bool makeViewsMapped(PatternType type, const std::function<QString(int index)>& fileName,
+                                int width, int height, int number, const std::vector<int>& indices, bool sync);
+
+    /**
+     * @brief interleave - renders the views of 'type' at panel resolution and copies the
+     *                     subpixels 'interleaver' assigns to each view into 'composite',
+     *                     an RGB888 image of interleaver size. The composite is split into
+     *                     row bands, each rendering that band of every view and merging
+     *                     it straight away, the whole view stack is never kept in memory
+     */
+    static bool interleave(PatternType type, const Interleaver& interleaver, QImage& composite);
+
+    /**
+     * @brief makeInterleaved - saves the panel native composite of the views, see interleave()
+     */
+    static bool makeInterleaved(PatternType type, const QString& filePath, const Interleaver& interleaver);
+
+    /**
+     * @brief generatorVersion - identifies the pixels produced by this build with
+     *                           current settings, changes whenever output may change
+     */
+    static QString generatorVersion();
+
+    /**
+     * @brief setThreadCount - sets number of threads rendering views, the result
+     *                         does not depend on it
+     * @param threadCount - number of threads, 0 - ideal thread count
+     */
+    static void setThreadCount(int threadCount);
+
+    /**
+     * @brief setFastRasterEnabled - enables writing ACT patterns straight into 32-bit
+     *                               scanlines instead of painting them with QPainter
+     * @param enabled - true by default
+     */
+    static void setFastRasterEnabled(bool enabled);
+
+    /**
+     * @brief setGlyphAtlasEnabled - enables blitting numeric labels from pre-rendered
+     *                               digits instead of drawing them as text
+     * @param enabled - true by default
+     */
+    static void setGlyphAtlasEnabled(bool enabled);
+
+    /**
+     * @brief setStampCacheEnabled - enables compositing repeated ACT pins and alignment
+     *                               bar grids from stamps rendered once
+     * @param enabled - true by default
+     */
+    static void setStampCacheEnabled(bool enabled);
+
+    /**
+     * @brief setCompactFormatsEnabled - enables rendering each pattern in the narrowest
+     *                                   pixel format holding its colours instead of ARGB32
+     * @param enabled - true by default
+     */
+    static void setCompactFormatsEnabled(bool enabled);
+
+    /**
+     * @brief setViewDeltasEnabled - enables rendering views as a copy of the part all views
+     *                               share with only their differences painted on top, the
+     *                               result does not depend on it
+     * @param enabled - true by default
+     */
+    static void setViewDeltasEnabled(bool enabled);
+
+    /**
+     * @brief setEncoder - encoder of the files written by makePattern and makePatternStreamed
+     * @param settings - AUTO picks the backend by the file suffix by default
+     */
+    static void setEncoder(const ImageEncoder::Settings& settings);
+    static ImageEncoder::Settings encoder();
+
+    /**
+     * @brief patternFormat - pixel format images of 'type' are rendered and saved in:
+     *                        RGB888, or Indexed8 with a green palette for ACT, and
+     *                        ARGB32 when compact formats are disabled
+     */
+    static QImage::Format patternFormat(PatternType type);
+
     /**
      * @brief getPattern - provides 'number' images of size 'width' x 'height'
      *                     respective to provided pattern type
@@ -26,7 +191,30 @@ struct CalibrationFactory
      * @param width - width of image
      * @param height - height of image
      * @param number - number of images to be provided
-     * @return list of calibration images
+     * @return list of calibration images in patternFormat(type)
      */
     static std::vector<QImage> getPattern(PatternType type, int width, int height, int number);
+
+    using ViewCallback = std::function<bool(int index, const QImage& view)>;
+
+    /**
+     * @brief forEachView - renders the same views as getPattern and passes each of them
+     *                      to 'callback' as soon as it is ready, so only one view per
+     *                      rendering thread is kept in memory. With more than one thread
+     *                      callback is called concurrently and views may come in any order
+     * @param type - pattern type
+     * @param width - width of image
+     * @param height - height of image
+     * @param number - number of views
+     * @param callback - receives view index and view image, returns false to stop
+     * @return true if all views were rendered and accepted by callback
+     */
+    static bool forEachView(PatternType type, int width, int height, int number, const ViewCallback& callback);
+
+    /**
+     * @brief forEachView - renders only the views of 'number' listed in 'indices', they are
+     *                      the same images the whole set has at those indices
+     */
+    static bool forEachView(PatternType type, int width, int height, int number, const std::vector<int>& indices,
+                            const ViewCallback& callback);
 };
@@ -1,18 +1,55 @@
-QT += gui
+QT += gui network svg
 
 CONFIG += c++14 console
 CONFIG -= app_bundle
 
+LIBS += -lz
+
 # You can make your code fail to compile if it uses deprecated APIs.
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
         main.cpp \
-        CalibrationFactory.cpp
+        BatchManifest.cpp \
+        CalibrationFactory.cpp \
+        DisplayList.cpp \
+        FrameStream.cpp \
+        GlyphAtlas.cpp \
+        ImageEncoder.cpp \
+        Interleaver.cpp \
+        MappedImage.cpp \
+        PatternBackends.cpp \
+        PatternCache.cpp \
+        PatternServer.cpp \
+        PngStreamWriter.cpp \
+        Profiler.cpp \
+        RasterKernels.cpp \
+        ShardManifest.cpp \
+        StampCache.cpp \
+        ViewPipeline.cpp \
+        WorkerPool.cpp
 
 HEADERS += \
-        CalibrationFactory.h
+        BatchManifest.h \
+        BoundedQueue.h \
+        CalibrationFactory.h \
+        DisplayList.h \
+        FrameStream.h \
+        GlyphAtlas.h \
+        ImageEncoder.h \
+        Interleaver.h \
+        MappedImage.h \
+        PatternBackends.h \
+        PatternCache.h \
+        PatternServer.h \
+        PngStreamWriter.h \
+        Profiler.h \
+        RasterKernels.h \
+        ShardManifest.h \
+        StampCache.h \
+        ViewPipeline.h \
+        WorkerPool.h
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
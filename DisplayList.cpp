@@ -0,0 +1,167 @@
+#include "DisplayList.h"
+
+#include <algorithm>
+
+namespace {
+
+// pens and aliased rounding may touch pixels slightly outside of a primitive rect
+const qreal OVERDRAW_MARGIN = 2;
+
+bool intersects(const QRectF& rect, const QRectF& visibleRect)
+{
+    return rect.left() <= visibleRect.right() && rect.right() >= visibleRect.left() &&
+           rect.top() <= visibleRect.bottom() && rect.bottom() >= visibleRect.top();
+}
+
+bool inLayer(const DisplayList::Op& op, DisplayList::Layer layer)
+{
+    switch (layer) {
+        case DisplayList::INVARIANT_OPS:
+            return op.invariant;
+
+        case DisplayList::VARIANT_OPS:
+            return !op.invariant;
+
+        case DisplayList::ALL_OPS:
+            break;
+    }
+    return true;
+}
+
+} // namespace
+
+QRectF DisplayList::Op::bounds() const
+{
+    QRectF area = rect.normalized();
+    if (type == LATTICE && columns > 0) {
+        // the first row is shifted right by half a cell
+        area.adjust(0, 0, area.width() / columns / 2, 0);
+    }
+
+    // glyphs may overhang their text rect, by half of the pixel size at most
+    const qreal margin = type == TEXT ? OVERDRAW_MARGIN + pixelSize / 2 : OVERDRAW_MARGIN;
+    return area.adjusted(-margin, -margin, margin, margin);
+}
+
+bool DisplayList::Op::operator==(const Op& other) const
+{
+    return type == other.type && repeated == other.repeated && invariant == other.invariant && rect == other.rect &&
+           fill == other.fill && pen == other.pen && penWidth == other.penWidth && flags == other.flags &&
+           pixelSize == other.pixelSize && rows == other.rows && columns == other.columns &&
+           cellHeight == other.cellHeight && text == other.text;
+}
+
+void DisplayList::addRect(const QRectF& rect, QRgb fill, QRgb pen, qreal penWidth, bool repeated)
+{
+    Op op;
+    op.type = RECT;
+    op.repeated = repeated;
+    op.rect = rect;
+    op.fill = fill;
+    op.pen = pen;
+    op.penWidth = static_cast<float>(penWidth);
+    m_ops.push_back(op);
+}
+
+void DisplayList::addShadedRect(const QRectF& rect, QRgb color, bool repeated)
+{
+    Op op;
+    op.type = SHADED_RECT;
+    op.repeated = repeated;
+    op.rect = rect;
+    op.fill = color;
+    m_ops.push_back(op);
+}
+
+void DisplayList::addText(const QRectF& rect, int flags, const QString& text, int pixelSize, QRgb color)
+{
+    // labels repeat all over a pattern, each distinct string is stored once
+    auto index = m_textIndices.find(text);
+    if (index == m_textIndices.end()) {
+        index = m_textIndices.insert(text, m_texts.size());
+        m_texts.append(text);
+    }
+
+    Op op;
+    op.type = TEXT;
+    op.rect = rect;
+    op.fill = color;
+    op.flags = flags;
+    op.pixelSize = pixelSize;
+    op.text = index.value();
+    m_ops.push_back(op);
+}
+
+void DisplayList::addLattice(const QRectF& rect, int rows, int columns, qreal cellHeight, QRgb pen, qreal penWidth,
+                             bool repeated, bool invariant)
+{
+    Op op;
+    op.type = LATTICE;
+    op.repeated = repeated;
+    op.invariant = invariant;
+    op.rect = rect;
+    op.pen = pen;
+    op.penWidth = static_cast<float>(penWidth);
+    op.rows = rows;
+    op.columns = columns;
+    op.cellHeight = cellHeight;
+    m_ops.push_back(op);
+}
+
+bool DisplayList::isRasterizable() const
+{
+    if (qAlpha(m_background) != 0 && qAlpha(m_background) != 255) {
+        return false;
+    }
+
+    for (const auto& op : m_ops) {
+        const bool opaqueRect = op.type == RECT && qAlpha(op.fill) == 255 && qAlpha(op.pen) == 0;
+        if (!opaqueRect && op.type != SHADED_RECT) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DisplayList::hasInvariantOps() const
+{
+    return std::any_of(m_ops.begin(), m_ops.end(), [](const Op& op) { return op.invariant; });
+}
+
+std::vector<DisplayList::Op> DisplayList::collect(const QRectF& visibleRect, Layer layer) const
+{
+    std::vector<Op> result;
+    for (const auto& op : m_ops) {
+        if (inLayer(op, layer) && intersects(op.bounds(), visibleRect)) {
+            result.push_back(op);
+        }
+    }
+    return result;
+}
+
+void DisplayList::replay(DisplayListBackend& backend, const QRectF& visibleRect, Layer layer) const
+{
+    for (const auto& op : m_ops) {
+        if (!inLayer(op, layer) || !intersects(op.bounds(), visibleRect)) {
+            continue;
+        }
+
+        switch (op.type) {
+            case RECT:
+                backend.drawRect(op.rect, op.fill, op.pen, op.penWidth, op.repeated);
+                break;
+
+            case SHADED_RECT:
+                backend.drawShadedRect(op.rect, op.fill, op.repeated);
+                break;
+
+            case TEXT:
+                backend.drawText(op.rect, op.flags, m_texts.value(op.text), m_fontFamily, op.pixelSize, op.fill);
+                break;
+
+            case LATTICE:
+                backend.drawLattice(op.rect, op.rows, op.columns, op.cellHeight, op.pen, op.penWidth, op.repeated);
+                break;
+        }
+    }
+}
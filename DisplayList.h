@@ -0,0 +1,118 @@
+#pragma once
+
+#include <vector>
+
+#include <QHash>
+#include <QRectF>
+#include <QRgb>
+#include <QString>
+#include <QStringList>
+
+class DisplayListBackend;
+
+/**
+ * Pattern compiled into a flat list of drawing operations laid out for one canvas
+ * size. A list is immutable once compiled, so threads rendering different views or
+ * bands of the same canvas share it, and it is replayed by any DisplayListBackend:
+ * raster painting, direct scanline writing or vector output. Pixel sized details
+ * (margins, pins, fonts) are laid out for the canvas size, so another output size
+ * is compiled into a list of its own.
+ */
+class DisplayList
+{
+public:
+    enum OpType : quint8
+    {
+        RECT,        // 'rect' filled with 'fill' and outlined with 'pen'
+        SHADED_RECT, // 'rect' filled with 'fill' fading to black along its diagonal
+        TEXT,        // texts()['text'] drawn in 'rect' with 'flags' alignment, 'fill' colour
+        LATTICE      // 'rows' x 'columns' cells outlined in 'rect', the first row shifted by half a cell
+    };
+
+    struct Op
+    {
+        OpType type = RECT;
+        bool repeated = false; // same look all over the pattern, worth compositing from a stamp
+        bool invariant = false; // same in every view of the pattern, relative to the view
+        QRectF rect;
+        QRgb fill = 0;
+        QRgb pen = 0;
+        float penWidth = 1;
+        qint32 flags = 0;
+        qint32 pixelSize = 0;
+        qint32 rows = 0;
+        qint32 columns = 0;
+        qreal cellHeight = 0;
+        qint32 text = -1;
+
+        /**
+         * @brief bounds - area the operation may paint, used for culling
+         */
+        QRectF bounds() const;
+
+        bool operator==(const Op& other) const;
+        bool operator!=(const Op& other) const { return !(*this == other); }
+    };
+
+    enum Layer
+    {
+        ALL_OPS,
+        INVARIANT_OPS, // ops marked invariant, the common base of all views
+        VARIANT_OPS    // ops telling views apart
+    };
+
+    void setBackground(QRgb color) { m_background = color; }
+    QRgb background() const { return m_background; }
+
+    void setFontFamily(const QString& family) { m_fontFamily = family; }
+    const QString& fontFamily() const { return m_fontFamily; }
+
+    void addRect(const QRectF& rect, QRgb fill, QRgb pen, qreal penWidth, bool repeated = false);
+    void addShadedRect(const QRectF& rect, QRgb color, bool repeated = false);
+    void addText(const QRectF& rect, int flags, const QString& text, int pixelSize, QRgb color);
+    void addLattice(const QRectF& rect, int rows, int columns, qreal cellHeight, QRgb pen, qreal penWidth,
+                    bool repeated = false, bool invariant = false);
+
+    const std::vector<Op>& ops() const { return m_ops; }
+    const QStringList& texts() const { return m_texts; }
+
+    /**
+     * @brief isRasterizable - true if the list has opaque rectangles only, which are
+     *                         written directly into scanlines without a painter
+     */
+    bool isRasterizable() const;
+
+    bool hasInvariantOps() const;
+
+    /**
+     * @brief collect - ops of 'layer' touching 'visibleRect' in list order
+     */
+    std::vector<Op> collect(const QRectF& visibleRect, Layer layer) const;
+
+    /**
+     * @brief replay - passes operations of 'layer' touching 'visibleRect' to 'backend' in list order
+     */
+    void replay(DisplayListBackend& backend, const QRectF& visibleRect, Layer layer = ALL_OPS) const;
+
+private:
+    std::vector<Op> m_ops;
+    QStringList m_texts;
+    QHash<QString, int> m_textIndices;
+    QString m_fontFamily;
+    QRgb m_background = 0;
+};
+
+/**
+ * Target of a display list replay. Coordinates are those of the list, backends map
+ * them to their device.
+ */
+class DisplayListBackend
+{
+public:
+    virtual ~DisplayListBackend() = default;
+
+    virtual void drawRect(const QRectF& rect, QRgb fill, QRgb pen, qreal penWidth, bool repeated) = 0;
+    virtual void drawShadedRect(const QRectF& rect, QRgb color, bool repeated) = 0;
+    virtual void drawText(const QRectF& rect, int flags, const QString& text, const QString& fontFamily, int pixelSize, QRgb color) = 0;
+    virtual void drawLattice(const QRectF& rect, int rows, int columns, qreal cellHeight, QRgb pen, qreal penWidth, bool repeated) = 0;
+};
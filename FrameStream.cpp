@@ -0,0 +1,178 @@
+#include "FrameStream.h"
+#include "Profiler.h"
+#include "WorkerPool.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+#include <QDebug>
+#include <QtEndian>
+
+namespace {
+
+const QByteArray Y4M_FRAME = "FRAME\n";
+const QByteArray RAW_MAGIC = "CIFR";
+const int RAW_HEADER_SIZE = 16;
+const int CHANNELS = 3;
+
+/**
+ * BT.601 limited range in 8-bit fixed point, the matrix Y4M consumers assume.
+ */
+QByteArray yuvFrame(const QImage& rgb)
+{
+    const int width = rgb.width();
+    const int height = rgb.height();
+    if (Y4M_FRAME.size() + CHANNELS * static_cast<qint64>(width) * height > std::numeric_limits<int>::max()) {
+        return {};
+    }
+
+    const int planeSize = width * height;
+
+    QByteArray frame {Y4M_FRAME.size() + CHANNELS * planeSize, Qt::Uninitialized};
+    std::memcpy(frame.data(), Y4M_FRAME.constData(), static_cast<size_t>(Y4M_FRAME.size()));
+    auto* luma = reinterpret_cast<uchar*>(frame.data()) + Y4M_FRAME.size();
+    uchar* blue = luma + planeSize;
+    uchar* red = blue + planeSize;
+
+    for (int y = 0; y < height; ++y) {
+        const uchar* pixel = rgb.constScanLine(y);
+        const int offset = y * width;
+        for (int x = 0; x < width; ++x, pixel += CHANNELS) {
+            const int r = pixel[0];
+            const int g = pixel[1];
+            const int b = pixel[2];
+            luma[offset + x] = static_cast<uchar>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+            blue[offset + x] = static_cast<uchar>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            red[offset + x] = static_cast<uchar>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+    return frame;
+}
+
+QByteArray rawFrame(const QImage& rgb)
+{
+    const int lineSize = rgb.width() * CHANNELS;
+    if (RAW_HEADER_SIZE + static_cast<qint64>(lineSize) * rgb.height() > std::numeric_limits<int>::max()) {
+        return {};
+    }
+
+    QByteArray frame {RAW_HEADER_SIZE + lineSize * rgb.height(), Qt::Uninitialized};
+    auto* data = reinterpret_cast<uchar*>(frame.data());
+    std::memcpy(data, RAW_MAGIC.constData(), 4);
+    qToLittleEndian<quint32>(static_cast<quint32>(rgb.width()), data + 4);
+    qToLittleEndian<quint32>(static_cast<quint32>(rgb.height()), data + 8);
+    qToLittleEndian<quint32>(CHANNELS, data + 12);
+
+    uchar* line = data + RAW_HEADER_SIZE;
+    for (int y = 0; y < rgb.height(); ++y, line += lineSize) {
+        std::memcpy(line, rgb.constScanLine(y), static_cast<size_t>(lineSize));
+    }
+    return frame;
+}
+
+} // namespace
+
+FrameStream::FrameStream(Format format)
+    : m_format(format)
+{}
+
+bool FrameStream::isStreamPath(const QString& filePath)
+{
+    return filePath == "-";
+}
+
+bool FrameStream::parseFormat(const QString& name, Format& format)
+{
+    const int index = formatNames().indexOf(name.toLower());
+    if (index < 0) {
+        return false;
+    }
+    format = static_cast<Format>(index);
+    return true;
+}
+
+QStringList FrameStream::formatNames()
+{
+    return {"y4m", "raw"};
+}
+
+bool FrameStream::open()
+{
+    return m_file.open(stdout, QIODevice::WriteOnly, QFileDevice::DontCloseHandle);
+}
+
+bool FrameStream::writeFrame(const QImage& frame)
+{
+    const QByteArray data = encode(frame);
+    std::lock_guard<std::mutex> lock {m_mutex};
+    return write(data, frame.size());
+}
+
+bool FrameStream::writeViews(CalibrationFactory::PatternType type, int width, int height, int number)
+{
+    if (width <= 0 || height <= 0 || number <= 0) {
+        return false;
+    }
+
+    // views are encoded as soon as they are rendered and wait only for their turn to be
+    // written; workers take view indices in order, so the next view is always in work.
+    // A view failing to render still takes its turn, so no worker waits for it forever
+    std::mutex turnMutex;
+    std::condition_variable turn;
+    int next = 0;
+    std::atomic<bool> failed {false};
+
+    WorkerPool::shared().run(number, [&](int i) {
+        QImage view {width, height, CalibrationFactory::patternFormat(type)};
+        const bool rendered = !failed && CalibrationFactory::renderView(type, view, number, i);
+        const QByteArray data = rendered ? encode(view) : QByteArray{};
+
+        std::unique_lock<std::mutex> lock {turnMutex};
+        turn.wait(lock, [&] { return next == i; });
+        if (!failed) {
+            std::lock_guard<std::mutex> streamLock {m_mutex};
+            failed = !rendered || !write(data, view.size());
+        }
+        ++next;
+        turn.notify_all();
+    });
+    return !failed;
+}
+
+QByteArray FrameStream::encode(const QImage& frame) const
+{
+    Profiler::Scope scope {"encode"};
+    const QImage rgb = frame.format() == QImage::Format_RGB888 ? frame : frame.convertToFormat(QImage::Format_RGB888);
+    return m_format == Y4M ? yuvFrame(rgb) : rawFrame(rgb);
+}
+
+bool FrameStream::write(const QByteArray& frame, const QSize& size)
+{
+    if (!m_file.isOpen() || frame.isEmpty()) {
+        return false;
+    }
+
+    Profiler::Scope scope {"write", m_frames};
+    if (m_format == Y4M) {
+        if (m_size.isEmpty()) {
+            m_size = size;
+            const QByteArray header = QString{"YUV4MPEG2 W%1 H%2 F%3:1 Ip A1:1 C444 XCOLORRANGE=LIMITED\n"}
+                                      .arg(size.width()).arg(size.height()).arg(FRAME_RATE).toLatin1();
+            if (m_file.write(header) != header.size()) {
+                return false;
+            }
+        } else if (size != m_size) {
+            qWarning() << "Y4M frames share the size of the first one, raw stream takes frames of any size";
+            return false;
+        }
+    }
+
+    if (m_file.write(frame) != frame.size() || !m_file.flush()) {
+        return false;
+    }
+    ++m_frames;
+    return true;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <mutex>
+
+#include <QFile>
+#include <QImage>
+#include <QSize>
+#include <QStringList>
+
+#include "CalibrationFactory.h"
+
+/**
+ * Sequence of patterns written as one continuous multi-frame stream to stdout, so
+ * pipe based consumers get every frame as soon as it is rendered, without files:
+ *
+ *     Y4M - YUV4MPEG2 header sized by the first frame, then "FRAME\n" and 4:4:4
+ *           planes of every frame, BT.601 limited range. All frames share one size.
+ *     RAW - every frame is a 16-byte header, "CIFR" and width, height and number
+ *           of channels (3) as 32-bit little endian integers, then packed RGB888 rows.
+ */
+class FrameStream
+{
+public:
+    enum Format
+    {
+        Y4M,
+        RAW
+    };
+
+    static const int FRAME_RATE = 25; // nominal rate of Y4M streams, frames come as fast as rendered
+
+    explicit FrameStream(Format format);
+
+    FrameStream(const FrameStream&) = delete;
+    FrameStream& operator=(const FrameStream&) = delete;
+
+    /**
+     * @brief isStreamPath - checks whether 'filePath' stands for the stream, "-"
+     */
+    static bool isStreamPath(const QString& filePath);
+
+    static bool parseFormat(const QString& name, Format& format);
+    static QStringList formatNames();
+
+    /**
+     * @brief open - opens stdout for binary writing
+     */
+    bool open();
+
+    /**
+     * @brief writeFrame - appends 'frame' to the stream and flushes it
+     */
+    bool writeFrame(const QImage& frame);
+
+    /**
+     * @brief writeViews - renders 'number' views concurrently and appends them in index order,
+     *                     each one as soon as it and all views before it are rendered
+     */
+    bool writeViews(CalibrationFactory::PatternType type, int width, int height, int number);
+
+    int frameCount() const { return m_frames; }
+
+private:
+    QByteArray encode(const QImage& frame) const;
+    bool write(const QByteArray& frame, const QSize& size);
+
+    Format m_format;
+    QFile m_file;
+    std::mutex m_mutex;
+    QSize m_size; // of Y4M frames, empty until the header is written
+    int m_frames = 0;
+};
@@ -0,0 +1,124 @@
+#include "GlyphAtlas.h"
+#include "Profiler.h"
+
+#include <map>
+#include <mutex>
+#include <tuple>
+
+#include <QFontMetrics>
+#include <QPainter>
+
+namespace {
+
+using AtlasKey = std::tuple<QString, int, QRgb>;
+
+std::mutex atlasesMutex;
+std::map<AtlasKey, std::shared_ptr<const GlyphAtlas>> atlases;
+
+} // namespace
+
+std::shared_ptr<const GlyphAtlas> GlyphAtlas::get(const QString& family, int pixelSize, QRgb color)
+{
+    const AtlasKey key {family, pixelSize, color};
+
+    std::lock_guard<std::mutex> lock {atlasesMutex};
+    auto& atlas = atlases[key];
+    if (!atlas) {
+        // the first atlas also pays for loading the font database
+        Profiler::Scope scope {"glyph atlas"};
+        atlas.reset(new GlyphAtlas{family, pixelSize, color});
+    }
+    return atlas;
+}
+
+GlyphAtlas::GlyphAtlas(const QString& family, int pixelSize, QRgb color)
+    : m_font(family)
+    , m_color(color)
+{
+    m_font.setPixelSize(qMax(1, pixelSize));
+
+    const QFontMetrics fm {m_font};
+    m_height = fm.height();
+    m_ascent = fm.ascent();
+
+    // glyphs may overhang their advance, cells keep some room around them
+    m_padding = m_font.pixelSize() / 2 + 1;
+    for (int i = 0; i < DIGITS; ++i) {
+        m_advances[i] = fm.horizontalAdvance(QChar{'0' + i});
+        m_cellWidth = qMax(m_cellWidth, m_advances[i] + m_padding * 2);
+    }
+
+    m_image = QImage{m_cellWidth * DIGITS, m_height + m_padding * 2, QImage::Format_ARGB32_Premultiplied};
+    m_image.fill(Qt::transparent);
+
+    QPainter painter {&m_image};
+    painter.setFont(m_font);
+    painter.setPen(QColor::fromRgba(m_color));
+    for (int i = 0; i < DIGITS; ++i) {
+        painter.drawText(QPoint{i * m_cellWidth + m_padding, m_padding + m_ascent}, QString{QChar{'0' + i}});
+    }
+}
+
+bool GlyphAtlas::canBlit(const QString& text)
+{
+    for (const QChar c : text) {
+        if (c.unicode() < '0' || c.unicode() > '9') {
+            return false;
+        }
+    }
+    return true;
+}
+
+int GlyphAtlas::horizontalAdvance(const QString& text) const
+{
+    int advance = 0;
+    for (const QChar c : text) {
+        advance += m_advances[c.unicode() - '0'];
+    }
+    return advance;
+}
+
+QSize GlyphAtlas::size(const QString& text) const
+{
+    return {horizontalAdvance(text), m_height};
+}
+
+void GlyphAtlas::draw(QPainter& painter, const QRectF& rect, int flags, const QString& text) const
+{
+    const QSizeF textSize = size(text);
+
+    qreal x = rect.left();
+    if (flags & Qt::AlignRight) {
+        x = rect.right() - textSize.width();
+    } else if (flags & Qt::AlignHCenter) {
+        x = rect.left() + (rect.width() - textSize.width()) / 2;
+    }
+
+    qreal y = rect.top();
+    if (flags & Qt::AlignBottom) {
+        y = rect.bottom() - textSize.height();
+    } else if (flags & Qt::AlignVCenter) {
+        y = rect.top() + (rect.height() - textSize.height()) / 2;
+    }
+
+    // like drawText, clip only text which does not fit
+    const bool clip = !rect.contains(QRectF{QPointF{x, y}, textSize});
+    const QRect clipRect {qRound(rect.left()), qRound(rect.top()),
+                          qRound(rect.right()) - qRound(rect.left()), qRound(rect.bottom()) - qRound(rect.top())};
+
+    int penX = qRound(x);
+    const int top = qRound(y) - m_padding;
+    for (const QChar c : text) {
+        const int digit = c.unicode() - '0';
+        QRect target {penX - m_padding, top, m_cellWidth, m_image.height()};
+        if (clip) {
+            target &= clipRect;
+        }
+
+        if (!target.isEmpty()) {
+            const QPoint source = target.topLeft() - QPoint{penX - m_padding, top} + QPoint{digit * m_cellWidth, 0};
+            painter.drawImage(target.topLeft(), m_image, QRect{source, target.size()});
+        }
+        penX += m_advances[digit];
+    }
+}
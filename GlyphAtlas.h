@@ -0,0 +1,67 @@
+#pragma once
+
+#include <memory>
+
+#include <QFont>
+#include <QImage>
+#include <QRectF>
+#include <QString>
+
+class QPainter;
+
+/**
+ * Digits '0'-'9' of one font, pixel size and colour rendered once per process.
+ * Numeric labels are composed by blitting the pre-rendered glyphs, so text is
+ * neither shaped nor rasterized again for every label.
+ */
+class GlyphAtlas
+{
+public:
+    /**
+     * @brief get - provides shared atlas, renders it on first request
+     * @param family - font family
+     * @param pixelSize - font pixel size
+     * @param color - text colour
+     */
+    static std::shared_ptr<const GlyphAtlas> get(const QString& family, int pixelSize, QRgb color);
+
+    const QFont& font() const { return m_font; }
+    int pixelSize() const { return m_font.pixelSize(); }
+    QRgb color() const { return m_color; }
+    int height() const { return m_height; }
+
+    /**
+     * @brief canBlit - checks whether all characters of 'text' are in the atlas
+     */
+    static bool canBlit(const QString& text);
+
+    /**
+     * @brief horizontalAdvance - same as QFontMetrics::horizontalAdvance for 'text'
+     */
+    int horizontalAdvance(const QString& text) const;
+
+    /**
+     * @brief size - same as QFontMetrics::size(Qt::TextSingleLine, text)
+     */
+    QSize size(const QString& text) const;
+
+    /**
+     * @brief draw - blits 'text' aligned within 'rect' by 'flags' the way QPainter::drawText
+     *               lays out a single line, clipped by 'rect' when text does not fit it
+     */
+    void draw(QPainter& painter, const QRectF& rect, int flags, const QString& text) const;
+
+private:
+    GlyphAtlas(const QString& family, int pixelSize, QRgb color);
+
+    static const int DIGITS = 10;
+
+    QFont m_font;
+    QRgb m_color;
+    int m_height = 0;
+    int m_ascent = 0;
+    int m_padding = 0;
+    int m_cellWidth = 0;
+    int m_advances[DIGITS] = {};
+    QImage m_image;
+};
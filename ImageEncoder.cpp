@@ -0,0 +1,589 @@
+#include "ImageEncoder.h"
+#include "PngStreamWriter.h"
+
+#include <array>
+#include <cstring>
+#include <vector>
+
+#include <QFileInfo>
+#include <QIODevice>
+#include <QImageWriter>
+#include <QSaveFile>
+#include <QtEndian>
+
+namespace {
+
+const int FAST_PNG_LEVEL = 1;
+const size_t OUTPUT_FLUSH_SIZE = 1 << 16;
+
+const std::array<QString, 7> BACKEND_NAMES = {"auto", "qt", "png", "fastpng", "ppm", "bmp", "qoi"};
+
+bool isEightBit(QImage::Format format)
+{
+    return format == QImage::Format_Indexed8 || format == QImage::Format_Grayscale8;
+}
+
+/**
+ * Base of the encoders writing pixels one row at a time. Rows come in their own
+ * format if it is one of the packed ones, through ARGB32 otherwise.
+ */
+class RowEncoder : public ImageEncoder
+{
+public:
+    explicit RowEncoder(QIODevice* device)
+        : m_device(device)
+    {}
+
+    bool begin(int width, int height, QImage::Format format, const QVector<QRgb>& colorTable) override
+    {
+        if (!m_device || width <= 0 || height <= 0 || m_width > 0) {
+            return false;
+        }
+
+        if (format == QImage::Format_Indexed8 && (colorTable.isEmpty() || colorTable.size() > 256)) {
+            return false;
+        }
+
+        m_width = width;
+        m_height = height;
+        m_format = format;
+        m_colorTable = colorTable;
+        m_colorTable.resize(256);
+        return writeHeader() && flush();
+    }
+
+    bool writeRows(const QImage& band) override
+    {
+        if (m_width <= 0 || m_failed || band.width() != m_width || m_rowsWritten + band.height() > m_height) {
+            return false;
+        }
+
+        // indices and intensities have no meaning in any other format
+        if (isEightBit(m_format) != isEightBit(band.format()) || (isEightBit(m_format) && m_format != band.format())) {
+            return false;
+        }
+
+        const QImage source = isPacked(band.format()) ? band : band.convertToFormat(QImage::Format_ARGB32);
+        for (int y = 0; y < source.height(); ++y) {
+            encodeRow(source.constScanLine(y), source.format());
+            ++m_rowsWritten;
+
+            if (m_output.size() >= OUTPUT_FLUSH_SIZE && !flush()) {
+                return false;
+            }
+        }
+        return flush();
+    }
+
+    bool finish() override
+    {
+        if (m_width <= 0 || m_failed || m_rowsWritten != m_height) {
+            return false;
+        }
+        writeTrailer();
+        return flush();
+    }
+
+protected:
+    virtual bool writeHeader() = 0;
+    virtual void encodeRow(const uchar* scanLine, QImage::Format format) = 0;
+    virtual void writeTrailer() {}
+
+    static bool isPacked(QImage::Format format)
+    {
+        switch (format) {
+            case QImage::Format_RGB888:
+            case QImage::Format_RGB32:
+            case QImage::Format_ARGB32:
+            case QImage::Format_Indexed8:
+            case QImage::Format_Grayscale8:
+                return true;
+
+            default:
+                return false;
+        }
+    }
+
+    /**
+     * @brief packRow - converts scanline into m_packed bytes R, G, B and A if 'alpha'
+     */
+    void packRow(const uchar* scanLine, QImage::Format format, bool alpha)
+    {
+        const int channels = alpha ? 4 : 3;
+        m_packed.resize(static_cast<size_t>(m_width) * channels);
+        uchar* target = m_packed.data();
+
+        for (int x = 0; x < m_width; ++x, target += channels) {
+            QRgb color = 0;
+            switch (format) {
+                case QImage::Format_RGB888:
+                    color = qRgb(scanLine[x * 3], scanLine[x * 3 + 1], scanLine[x * 3 + 2]);
+                    break;
+
+                case QImage::Format_Indexed8:
+                    color = m_colorTable[scanLine[x]];
+                    break;
+
+                case QImage::Format_Grayscale8:
+                    color = qRgb(scanLine[x], scanLine[x], scanLine[x]);
+                    break;
+
+                case QImage::Format_RGB32:
+                    color = reinterpret_cast<const QRgb*>(scanLine)[x] | 0xff000000;
+                    break;
+
+                default:
+                    color = reinterpret_cast<const QRgb*>(scanLine)[x];
+                    break;
+            }
+
+            target[0] = static_cast<uchar>(qRed(color));
+            target[1] = static_cast<uchar>(qGreen(color));
+            target[2] = static_cast<uchar>(qBlue(color));
+            if (alpha) {
+                target[3] = static_cast<uchar>(qAlpha(color));
+            }
+        }
+    }
+
+    void append(const void* data, size_t size)
+    {
+        const auto* bytes = static_cast<const uchar*>(data);
+        m_output.insert(m_output.end(), bytes, bytes + size);
+    }
+
+    bool flush()
+    {
+        if (!m_output.empty() &&
+            m_device->write(reinterpret_cast<const char*>(m_output.data()), static_cast<qint64>(m_output.size())) !=
+            static_cast<qint64>(m_output.size())) {
+            m_failed = true;
+        }
+        m_output.clear();
+        return !m_failed;
+    }
+
+    QIODevice* m_device;
+    int m_width = 0;
+    int m_height = 0;
+    int m_rowsWritten = 0;
+    bool m_failed = false;
+    QImage::Format m_format = QImage::Format_Invalid;
+    QVector<QRgb> m_colorTable;
+    std::vector<uchar> m_packed;
+    std::vector<uchar> m_output;
+};
+
+/**
+ * Binary PPM (P6), or PGM (P5) holding the intensities of grayscale images. A PGM
+ * file of a colour image gets the qGray() of every pixel, as Qt writes it.
+ */
+class PpmEncoder : public RowEncoder
+{
+public:
+    PpmEncoder(QIODevice* device, bool gray)
+        : RowEncoder(device)
+        , m_gray(gray)
+    {}
+
+protected:
+    bool writeHeader() override
+    {
+        const QByteArray header = QString{"%1\n%2 %3\n255\n"}
+                .arg(m_gray || m_format == QImage::Format_Grayscale8 ? "P5" : "P6").arg(m_width).arg(m_height).toLatin1();
+        append(header.constData(), static_cast<size_t>(header.size()));
+        return true;
+    }
+
+    void encodeRow(const uchar* scanLine, QImage::Format format) override
+    {
+        if (format == QImage::Format_Grayscale8 || (format == QImage::Format_RGB888 && !m_gray)) {
+            append(scanLine, static_cast<size_t>(m_width) * (format == QImage::Format_Grayscale8 ? 1 : 3));
+            return;
+        }
+
+        packRow(scanLine, format, false);
+        if (!m_gray) {
+            append(m_packed.data(), m_packed.size());
+            return;
+        }
+
+        for (int x = 0; x < m_width; ++x) {
+            const uchar* pixel = m_packed.data() + x * 3;
+            m_packed[static_cast<size_t>(x)] = static_cast<uchar>(qGray(pixel[0], pixel[1], pixel[2]));
+        }
+        append(m_packed.data(), static_cast<size_t>(m_width));
+    }
+
+private:
+    bool m_gray;
+};
+
+/**
+ * Uncompressed top-down BMP: 8-bit with the colour table for indexed images and a
+ * gray ramp for grayscale ones, 24-bit otherwise. Alpha is not kept.
+ */
+class BmpEncoder : public RowEncoder
+{
+public:
+    using RowEncoder::RowEncoder;
+
+protected:
+    bool writeHeader() override
+    {
+        const bool indexed = isEightBit(m_format);
+        const quint32 bitsPerPixel = indexed ? 8 : 24;
+        const quint32 paletteSize = indexed ? 256 * 4 : 0;
+        const quint32 dataOffset = 14 + 40 + paletteSize;
+        m_stride = (m_width * bitsPerPixel / 8 + 3) & ~3u;
+
+        const quint64 fileSize = dataOffset + static_cast<quint64>(m_stride) * m_height;
+        if (fileSize > 0xffffffffu) {
+            return false;
+        }
+
+        uchar header[14 + 40] = {};
+        header[0] = 'B';
+        header[1] = 'M';
+        qToLittleEndian<quint32>(static_cast<quint32>(fileSize), header + 2);
+        qToLittleEndian<quint32>(dataOffset, header + 10);
+
+        uchar* info = header + 14;
+        qToLittleEndian<quint32>(40, info);
+        qToLittleEndian<qint32>(m_width, info + 4);
+        qToLittleEndian<qint32>(-m_height, info + 8); // negative height - rows go top to bottom
+        qToLittleEndian<quint16>(1, info + 12);
+        qToLittleEndian<quint16>(static_cast<quint16>(bitsPerPixel), info + 14);
+        qToLittleEndian<quint32>(static_cast<quint32>(m_stride) * m_height, info + 20);
+        qToLittleEndian<qint32>(2835, info + 24); // 72 dpi
+        qToLittleEndian<qint32>(2835, info + 28);
+        qToLittleEndian<quint32>(indexed ? 256 : 0, info + 32);
+        append(header, sizeof(header));
+
+        for (int i = 0; indexed && i < 256; ++i) {
+            const QRgb color = m_format == QImage::Format_Grayscale8 ? qRgb(i, i, i) : m_colorTable[i];
+            const uchar entry[4] = {static_cast<uchar>(qBlue(color)), static_cast<uchar>(qGreen(color)),
+                                    static_cast<uchar>(qRed(color)), 0};
+            append(entry, sizeof(entry));
+        }
+        return true;
+    }
+
+    void encodeRow(const uchar* scanLine, QImage::Format format) override
+    {
+        const size_t start = m_output.size();
+        if (isEightBit(format)) {
+            append(scanLine, static_cast<size_t>(m_width));
+        } else {
+            packRow(scanLine, format, false);
+            for (size_t i = 0; i < m_packed.size(); i += 3) {
+                std::swap(m_packed[i], m_packed[i + 2]);
+            }
+            append(m_packed.data(), m_packed.size());
+        }
+        m_output.resize(start + m_stride, 0);
+    }
+
+private:
+    quint32 m_stride = 0;
+};
+
+/**
+ * QOI, see qoiformat.org. Flat colours turn into runs, the encoder state carries
+ * over from row to row.
+ */
+class QoiEncoder : public RowEncoder
+{
+public:
+    using RowEncoder::RowEncoder;
+
+protected:
+    enum Op : uchar
+    {
+        OP_INDEX = 0x00,
+        OP_DIFF = 0x40,
+        OP_LUMA = 0x80,
+        OP_RUN = 0xc0,
+        OP_RGB = 0xfe,
+        OP_RGBA = 0xff
+    };
+
+    static const int MAX_RUN = 62;
+
+    bool writeHeader() override
+    {
+        m_channels = QImage::toPixelFormat(m_format).alphaUsage() == QPixelFormat::UsesAlpha ? 4 : 3;
+
+        uchar header[14] = {'q', 'o', 'i', 'f'};
+        qToBigEndian<quint32>(static_cast<quint32>(m_width), header + 4);
+        qToBigEndian<quint32>(static_cast<quint32>(m_height), header + 8);
+        header[12] = static_cast<uchar>(m_channels);
+        header[13] = 0; // sRGB with linear alpha
+        append(header, sizeof(header));
+        return true;
+    }
+
+    void encodeRow(const uchar* scanLine, QImage::Format format) override
+    {
+        packRow(scanLine, format, true);
+        for (size_t i = 0; i < m_packed.size(); i += 4) {
+            encodePixel(qRgba(m_packed[i], m_packed[i + 1], m_packed[i + 2], m_channels == 4 ? m_packed[i + 3] : 255));
+        }
+    }
+
+    void writeTrailer() override
+    {
+        flushRun();
+        const uchar end[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+        append(end, sizeof(end));
+    }
+
+private:
+    void flushRun()
+    {
+        if (m_run > 0) {
+            m_output.push_back(static_cast<uchar>(OP_RUN | (m_run - 1)));
+            m_run = 0;
+        }
+    }
+
+    void encodePixel(QRgb pixel)
+    {
+        if (pixel == m_previous) {
+            if (++m_run == MAX_RUN) {
+                flushRun();
+            }
+            return;
+        }
+        flushRun();
+
+        const int hash = (qRed(pixel) * 3 + qGreen(pixel) * 5 + qBlue(pixel) * 7 + qAlpha(pixel) * 11) % 64;
+        if (m_index[hash] == pixel) {
+            m_output.push_back(static_cast<uchar>(OP_INDEX | hash));
+        } else {
+            m_index[hash] = pixel;
+
+            if (qAlpha(pixel) == qAlpha(m_previous)) {
+                const int vr = static_cast<signed char>(qRed(pixel) - qRed(m_previous));
+                const int vg = static_cast<signed char>(qGreen(pixel) - qGreen(m_previous));
+                const int vb = static_cast<signed char>(qBlue(pixel) - qBlue(m_previous));
+                const int vgr = vr - vg;
+                const int vgb = vb - vg;
+
+                if (vr >= -2 && vr <= 1 && vg >= -2 && vg <= 1 && vb >= -2 && vb <= 1) {
+                    m_output.push_back(static_cast<uchar>(OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2)));
+                } else if (vg >= -32 && vg <= 31 && vgr >= -8 && vgr <= 7 && vgb >= -8 && vgb <= 7) {
+                    m_output.push_back(static_cast<uchar>(OP_LUMA | (vg + 32)));
+                    m_output.push_back(static_cast<uchar>((vgr + 8) << 4 | (vgb + 8)));
+                } else {
+                    const uchar rgb[4] = {OP_RGB, static_cast<uchar>(qRed(pixel)), static_cast<uchar>(qGreen(pixel)),
+                                          static_cast<uchar>(qBlue(pixel))};
+                    append(rgb, sizeof(rgb));
+                }
+            } else {
+                const uchar rgba[5] = {OP_RGBA, static_cast<uchar>(qRed(pixel)), static_cast<uchar>(qGreen(pixel)),
+                                       static_cast<uchar>(qBlue(pixel)), static_cast<uchar>(qAlpha(pixel))};
+                append(rgba, sizeof(rgba));
+            }
+        }
+        m_previous = pixel;
+    }
+
+    int m_channels = 3;
+    int m_run = 0;
+    QRgb m_previous = qRgba(0, 0, 0, 255);
+    QRgb m_index[64] = {};
+};
+
+/**
+ * QImageWriter of the file suffix, rows are gathered until the image is complete.
+ * Only callers feeding bands get it, encode() hands whole images to QImageWriter.
+ */
+class QtEncoder : public ImageEncoder
+{
+public:
+    QtEncoder(QIODevice* device, const QByteArray& format)
+        : m_device(device)
+        , m_format(format)
+    {}
+
+    bool begin(int width, int height, QImage::Format format, const QVector<QRgb>& colorTable) override
+    {
+        if (!m_device || width <= 0 || height <= 0 || !m_image.isNull()) {
+            return false;
+        }
+
+        m_image = QImage{width, height, format};
+        m_image.setColorTable(colorTable);
+        return !m_image.isNull();
+    }
+
+    bool writeRows(const QImage& band) override
+    {
+        if (m_image.isNull() || band.width() != m_image.width() || m_rowsWritten + band.height() > m_image.height()) {
+            return false;
+        }
+
+        const QImage source = band.format() == m_image.format() ? band : band.convertToFormat(m_image.format());
+        const int rowBytes = qMin(source.bytesPerLine(), m_image.bytesPerLine());
+        for (int y = 0; y < source.height(); ++y) {
+            std::memcpy(m_image.scanLine(m_rowsWritten++), source.constScanLine(y), rowBytes);
+        }
+        return true;
+    }
+
+    bool finish() override
+    {
+        if (m_image.isNull() || m_rowsWritten != m_image.height()) {
+            return false;
+        }
+
+        QImageWriter writer {m_device, m_format};
+        return writer.write(m_image);
+    }
+
+private:
+    QIODevice* m_device;
+    QByteArray m_format;
+    QImage m_image;
+    int m_rowsWritten = 0;
+};
+
+} // namespace
+
+std::unique_ptr<ImageEncoder> ImageEncoder::create(const Settings& settings, const QString& suffix, QIODevice* device,
+                                                   bool streaming)
+{
+    Backend backend = AUTO;
+    if (!resolve(settings.backend, suffix, backend, streaming)) {
+        return nullptr;
+    }
+
+    switch (backend) {
+        case PNG:
+            return std::unique_ptr<ImageEncoder>{new PngStreamWriter{device, settings.level >= 0 ? settings.level : Z_DEFAULT_COMPRESSION}};
+
+        case FAST_PNG:
+            // the "up" filter turns repeated rows into zeros and the rest are runs of one colour
+            return std::unique_ptr<ImageEncoder>{new PngStreamWriter{device, settings.level >= 0 ? settings.level : FAST_PNG_LEVEL, Z_RLE}};
+
+        case PPM:
+            return std::unique_ptr<ImageEncoder>{new PpmEncoder{device, suffix.compare("pgm", Qt::CaseInsensitive) == 0}};
+
+        case BMP:
+            return std::unique_ptr<ImageEncoder>{new BmpEncoder{device}};
+
+        case QOI:
+            return std::unique_ptr<ImageEncoder>{new QoiEncoder{device}};
+
+        case QT:
+        case AUTO:
+            break;
+    }
+    return std::unique_ptr<ImageEncoder>{new QtEncoder{device, suffix.toLower().toLatin1()}};
+}
+
+bool ImageEncoder::encode(const QImage& image, const Settings& settings, const QString& suffix, QIODevice* device)
+{
+    Backend backend = AUTO;
+    if (!resolve(settings.backend, suffix, backend)) {
+        return false;
+    }
+
+    // the image is complete already, QtEncoder would only gather a copy of it
+    if (backend == QT) {
+        QImageWriter writer {device, suffix.toLower().toLatin1()};
+        return device && writer.write(image);
+    }
+
+    const auto encoder = create(settings, suffix, device);
+    return encoder && encoder->begin(image.width(), image.height(), image.format(), image.colorTable()) &&
+           encoder->writeRows(image) && encoder->finish();
+}
+
+bool ImageEncoder::save(const QImage& image, const QString& filePath, const Settings& settings)
+{
+    QSaveFile file {filePath};
+    return file.open(QIODevice::WriteOnly) && encode(image, settings, QFileInfo{filePath}.suffix(), &file) && file.commit();
+}
+
+bool ImageEncoder::resolve(Backend backend, const QString& suffix, Backend& resolved, bool streaming)
+{
+    const QString format = suffix.toLower();
+    switch (backend) {
+        case AUTO:
+            // default output keeps the bytes Qt writes, own encoders serve what Qt can not
+            if (!streaming && QImageWriter::supportedImageFormats().contains(format.toLatin1())) {
+                resolved = QT;
+            } else if (format == "png") {
+                resolved = PNG;
+            } else if (format == "ppm" || format == "pgm") {
+                resolved = PPM;
+            } else if (format == "bmp") {
+                resolved = BMP;
+            } else if (format == "qoi") {
+                resolved = QOI;
+            } else {
+                resolved = QT;
+            }
+            return true;
+
+        case QT:
+            resolved = QT;
+            return QImageWriter::supportedImageFormats().contains(format.toLatin1());
+
+        case PNG:
+        case FAST_PNG:
+            resolved = backend;
+            return format == "png";
+
+        case PPM:
+            resolved = backend;
+            return format == "ppm" || format == "pgm";
+
+        case BMP:
+            resolved = backend;
+            return format == "bmp";
+
+        case QOI:
+            resolved = backend;
+            return format == "qoi";
+    }
+    return false;
+}
+
+bool ImageEncoder::isStreaming(Backend backend)
+{
+    return backend != QT && backend != AUTO;
+}
+
+bool ImageEncoder::hasLevel(Backend backend)
+{
+    return backend == PNG || backend == FAST_PNG;
+}
+
+bool ImageEncoder::parseBackend(const QString& name, Backend& backend)
+{
+    for (size_t i = 0; i < BACKEND_NAMES.size(); ++i) {
+        if (name.compare(BACKEND_NAMES[i], Qt::CaseInsensitive) == 0) {
+            backend = static_cast<Backend>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+QString ImageEncoder::backendName(Backend backend)
+{
+    return BACKEND_NAMES.at(static_cast<size_t>(backend));
+}
+
+QStringList ImageEncoder::backendNames()
+{
+    return QStringList{BACKEND_NAMES.begin(), BACKEND_NAMES.end()};
+}
+
+QString ImageEncoder::describe(const Settings& settings)
+{
+    return QString{"%1:%2"}.arg(backendName(settings.backend)).arg(settings.level);
+}
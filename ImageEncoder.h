@@ -0,0 +1,98 @@
+#pragma once
+
+#include <memory>
+
+#include <QImage>
+#include <QString>
+#include <QStringList>
+
+class QIODevice;
+
+/**
+ * Image file encoder fed row by row: begin() writes the header, every writeRows()
+ * appends a band of rows and finish() completes the file. All backends but QT
+ * encode each band right away, so they also serve streamed output.
+ */
+class ImageEncoder
+{
+public:
+    enum Backend
+    {
+        AUTO,     // QT for files Qt writes, otherwise, or for streamed output, picked by the file suffix
+        QT,       // QImageWriter, any format Qt writes, whole images only
+        PNG,      // streaming PNG at the chosen zlib level
+        FAST_PNG, // streaming PNG tuned for large solid runs
+        PPM,      // binary PPM, or PGM for grayscale images
+        BMP,      // uncompressed BMP, 8-bit with palette for indexed and grayscale images
+        QOI       // Quite OK Image format
+    };
+
+    struct Settings
+    {
+        Backend backend = AUTO;
+        int level = -1; // zlib level 0-9 of the PNG backends, -1 - backend default
+    };
+
+    virtual ~ImageEncoder() = default;
+
+    /**
+     * @brief begin - writes header of 'width' x 'height' image of 'format', 'colorTable'
+     *                is used for indexed formats
+     */
+    virtual bool begin(int width, int height, QImage::Format format, const QVector<QRgb>& colorTable = {}) = 0;
+
+    /**
+     * @brief writeRows - appends all rows of 'band', which has to be of image width and format
+     */
+    virtual bool writeRows(const QImage& band) = 0;
+
+    /**
+     * @brief finish - writes the rest of the file
+     * @return true if the whole image was written
+     */
+    virtual bool finish() = 0;
+
+    /**
+     * @brief create - encoder writing files of 'suffix' into 'device'
+     * @param streaming - AUTO picks an encoder writing bands as they come
+     * @return nullptr if the backend of 'settings' does not write such files
+     */
+    static std::unique_ptr<ImageEncoder> create(const Settings& settings, const QString& suffix, QIODevice* device,
+                                                bool streaming = false);
+
+    /**
+     * @brief encode - writes the whole 'image' as a file of 'suffix' into 'device'
+     */
+    static bool encode(const QImage& image, const Settings& settings, const QString& suffix, QIODevice* device);
+
+    /**
+     * @brief save - encodes 'image' into 'filePath', the file is replaced only once complete
+     */
+    static bool save(const QImage& image, const QString& filePath, const Settings& settings);
+
+    /**
+     * @brief resolve - backend writing files of 'suffix' for 'backend', AUTO is resolved
+     * @param streaming - AUTO picks a backend writing bands as they come
+     * @return false if 'backend' does not write such files
+     */
+    static bool resolve(Backend backend, const QString& suffix, Backend& resolved, bool streaming = false);
+
+    /**
+     * @brief isStreaming - true if the backend encodes bands as they come
+     */
+    static bool isStreaming(Backend backend);
+
+    /**
+     * @brief hasLevel - true if the backend takes Settings::level
+     */
+    static bool hasLevel(Backend backend);
+
+    static bool parseBackend(const QString& name, Backend& backend);
+    static QString backendName(Backend backend);
+    static QStringList backendNames();
+
+    /**
+     * @brief describe - backend and level, everything besides pixels defining the output bytes
+     */
+    static QString describe(const Settings& settings);
+};
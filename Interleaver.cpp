@@ -0,0 +1,134 @@
+#include "Interleaver.h"
+#include "Profiler.h"
+#include "RasterKernels.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <QStringList>
+
+namespace {
+
+const int BAND_HEIGHT = 64;
+
+int bandCount(int height)
+{
+    return (height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+}
+
+} // namespace
+
+Interleaver Interleaver::lenticular(const QSize& size, int views, const Lenticular& lens)
+{
+    Interleaver result;
+    if (size.isEmpty() || views <= 0 || views > MAX_VIEWS || !(lens.pitch > 0)) {
+        return result;
+    }
+
+    Profiler::Scope scope {"interleave map"};
+    const int lineSize = size.width() * 3;
+    result.m_size = size;
+    result.m_views = views;
+    result.m_map.resize(static_cast<size_t>(lineSize) * size.height());
+
+    WorkerPool::shared().run(bandCount(size.height()), [&](int band) {
+        const int last = std::min(size.height(), (band + 1) * BAND_HEIGHT);
+        for (int y = band * BAND_HEIGHT; y < last; ++y) {
+            uchar* line = result.m_map.data() + static_cast<size_t>(y) * lineSize;
+            const double start = 3.0 * y * lens.slant + lens.offset;
+            for (int i = 0; i < lineSize; ++i) {
+                const double position = (start + i) / lens.pitch;
+                const int view = static_cast<int>((position - std::floor(position)) * views);
+                line[i] = static_cast<uchar>(std::min(view, views - 1));
+            }
+        }
+    });
+    return result;
+}
+
+Interleaver Interleaver::fromLookupTable(const QImage& table, int views)
+{
+    Interleaver result;
+    if (table.isNull() || views <= 0 || views > MAX_VIEWS) {
+        return result;
+    }
+
+    const QImage rgb = table.convertToFormat(QImage::Format_RGB888);
+    const int lineSize = rgb.width() * 3;
+    std::vector<uchar> map(static_cast<size_t>(lineSize) * rgb.height());
+    for (int y = 0; y < rgb.height(); ++y) {
+        const uchar* line = rgb.constScanLine(y);
+        if (std::any_of(line, line + lineSize, [views](uchar view) { return view >= views; })) {
+            return result;
+        }
+        std::copy(line, line + lineSize, map.begin() + static_cast<std::ptrdiff_t>(y) * lineSize);
+    }
+
+    result.m_size = rgb.size();
+    result.m_views = views;
+    result.m_map = std::move(map);
+    return result;
+}
+
+bool Interleaver::parseLenticular(const QString& text, Lenticular& lens)
+{
+    const QStringList values = text.split(',');
+    if (values.size() < 2 || values.size() > 3) {
+        return false;
+    }
+
+    bool ok = true;
+    Lenticular parsed;
+    parsed.slant = values.at(0).trimmed().toDouble(&ok);
+    if (!ok) {
+        return false;
+    }
+
+    parsed.pitch = values.at(1).trimmed().toDouble(&ok);
+    if (!ok || !(parsed.pitch > 0)) {
+        return false;
+    }
+
+    if (values.size() == 3) {
+        parsed.offset = values.at(2).trimmed().toDouble(&ok);
+        if (!ok) {
+            return false;
+        }
+    }
+
+    lens = parsed;
+    return true;
+}
+
+bool Interleaver::add(QImage& composite, const QImage& view, int index) const
+{
+    if (view.size() != m_size) {
+        return false;
+    }
+
+    Profiler::Scope scope {"interleave", index};
+    return addRows(composite, view, index, 0);
+}
+
+bool Interleaver::addRows(QImage& composite, const QImage& band, int index, int top) const
+{
+    if (!isValid() || index < 0 || index >= m_views ||
+        composite.size() != m_size || composite.format() != QImage::Format_RGB888 ||
+        band.width() != m_size.width() || band.format() != QImage::Format_RGB888 ||
+        top < 0 || band.height() > m_size.height() - top) {
+        return false;
+    }
+
+    const int lineSize = m_size.width() * 3;
+    for (int y = 0; y < band.height(); ++y) {
+        RasterKernels::copyMatching(composite.scanLine(top + y), band.constScanLine(y), mapLine(top + y), lineSize,
+                                    static_cast<uchar>(index));
+    }
+    return true;
+}
+
+const uchar* Interleaver::mapLine(int y) const
+{
+    return m_map.data() + static_cast<size_t>(y) * m_size.width() * 3;
+}
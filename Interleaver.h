@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+
+#include <QImage>
+#include <QSize>
+#include <QString>
+
+/**
+ * Assignment of every subpixel of a multiview panel to one of its views. The panel
+ * native composite takes each subpixel from the view it is assigned to, views are
+ * RGB888 images of panel resolution and may be added one by one in any order, or
+ * band by band, so that every band of the composite is written by a single thread.
+ *
+ * The map holds one view index per subpixel, so a view is merged by a masked copy
+ * of whole rows rather than by a per-subpixel address computation.
+ */
+class Interleaver
+{
+public:
+    static const int MAX_VIEWS = 256;
+
+    /**
+     * Slanted lenticular sheet. Subpixel c of pixel (x, y), c being 0 - 2 for the
+     * red, green and blue one, lies at u = 3 * x + c + 3 * y * slant + offset under
+     * the lenses and is taken from view floor(frac(u / pitch) * views).
+     */
+    struct Lenticular
+    {
+        qreal slant = 0;  // horizontal shift of the lenses in pixels per row
+        qreal pitch = 0;  // lens width in subpixels
+        qreal offset = 0; // lens phase at the top-left subpixel in subpixels
+    };
+
+    Interleaver() = default;
+
+    /**
+     * @brief lenticular - map of a 'size' panel showing 'views' views through 'lens'
+     * @return invalid interleaver if pitch is not positive or views are out of [1, MAX_VIEWS]
+     */
+    static Interleaver lenticular(const QSize& size, int views, const Lenticular& lens);
+
+    /**
+     * @brief fromLookupTable - map read from 'table', an image of panel size whose red,
+     *                          green and blue channels hold view indices of the subpixels
+     * @return invalid interleaver if any index is not below 'views'
+     */
+    static Interleaver fromLookupTable(const QImage& table, int views);
+
+    /**
+     * @brief parseLenticular - reads "slant,pitch[,offset]"
+     */
+    static bool parseLenticular(const QString& text, Lenticular& lens);
+
+    bool isValid() const { return !m_map.empty(); }
+    QSize size() const { return m_size; }
+    int views() const { return m_views; }
+
+    /**
+     * @brief add - copies subpixels assigned to view 'index' from 'view' into 'composite',
+     *              both of them RGB888 images of interleaver size
+     */
+    bool add(QImage& composite, const QImage& view, int index) const;
+
+    /**
+     * @brief addRows - copies subpixels assigned to view 'index' from 'band', the rows
+     *                  of the view starting at row 'top', into the same composite rows
+     */
+    bool addRows(QImage& composite, const QImage& band, int index, int top) const;
+
+private:
+    const uchar* mapLine(int y) const;
+
+    QSize m_size;
+    int m_views = 0;
+    std::vector<uchar> m_map; // 3 * width view indices per row
+};
@@ -0,0 +1,257 @@
+#include "MappedImage.h"
+#include "Profiler.h"
+
+#include <cstring>
+#include <limits>
+
+#include <QFile>
+#include <QFileInfo>
+#include <QtEndian>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+enum Layout
+{
+    RAW,
+    PPM,
+    PGM,
+    BMP
+};
+
+bool fileLayout(const QString& filePath, Layout& layout)
+{
+    const QString suffix = QFileInfo{filePath}.suffix().toLower();
+    if (suffix == "raw") {
+        layout = RAW;
+    } else if (suffix == "ppm") {
+        layout = PPM;
+    } else if (suffix == "pgm") {
+        layout = PGM;
+    } else if (suffix == "bmp") {
+        layout = BMP;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+qint64 alignUp(qint64 value)
+{
+    return (value + MappedImage::PIXELS_ALIGNMENT - 1) / MappedImage::PIXELS_ALIGNMENT * MappedImage::PIXELS_ALIGNMENT;
+}
+
+/**
+ * Netpbm header with a comment stretching it up to the pixels alignment, the single
+ * whitespace after the maximum value has to be the last byte before pixels.
+ */
+QByteArray netpbmHeader(Layout layout, int width, int height)
+{
+    const QByteArray magic = layout == PGM ? "P5\n" : "P6\n";
+    const QByteArray size = QString{"%1 %2\n255\n"}.arg(width).arg(height).toLatin1();
+    const qint64 minimalSize = magic.size() + 2 + size.size(); // "#\n" at least
+
+    QByteArray comment {static_cast<int>(alignUp(minimalSize) - minimalSize + 1), ' '};
+    comment[0] = '#';
+    return magic + comment + '\n' + size;
+}
+
+QByteArray bmpHeader(int width, int height, QImage::Format format, const QVector<QRgb>& colorTable, int bytesPerLine)
+{
+    const bool indexed = format == QImage::Format_Indexed8 || format == QImage::Format_Grayscale8;
+    const int headerSize = 14 + 40;
+    const int paletteSize = indexed ? 256 * 4 : 0;
+    const qint64 dataOffset = alignUp(headerSize + paletteSize);
+    const qint64 fileSize = dataOffset + static_cast<qint64>(bytesPerLine) * height;
+    if (fileSize > 0xffffffffLL) {
+        return {};
+    }
+
+    QByteArray header {static_cast<int>(dataOffset), '\0'};
+    auto* data = reinterpret_cast<uchar*>(header.data());
+    data[0] = 'B';
+    data[1] = 'M';
+    qToLittleEndian<quint32>(static_cast<quint32>(fileSize), data + 2);
+    qToLittleEndian<quint32>(static_cast<quint32>(dataOffset), data + 10);
+
+    uchar* info = data + 14;
+    qToLittleEndian<quint32>(40, info);
+    qToLittleEndian<qint32>(width, info + 4);
+    qToLittleEndian<qint32>(-height, info + 8); // negative height - rows go top to bottom
+    qToLittleEndian<quint16>(1, info + 12);
+    qToLittleEndian<quint16>(indexed ? 8 : 24, info + 14);
+    qToLittleEndian<quint32>(static_cast<quint32>(bytesPerLine) * height, info + 20);
+    qToLittleEndian<qint32>(2835, info + 24); // 72 dpi
+    qToLittleEndian<qint32>(2835, info + 28);
+    qToLittleEndian<quint32>(indexed ? 256 : 0, info + 32);
+
+    uchar* palette = data + headerSize;
+    for (int i = 0; indexed && i < 256; ++i, palette += 4) {
+        const QRgb color = format == QImage::Format_Grayscale8 ? qRgb(i, i, i) : colorTable.value(i);
+        palette[0] = static_cast<uchar>(qBlue(color));
+        palette[1] = static_cast<uchar>(qGreen(color));
+        palette[2] = static_cast<uchar>(qRed(color));
+    }
+    return header;
+}
+
+} // namespace
+
+MappedImage::MappedImage(const QString& filePath)
+    : m_filePath(filePath)
+    , m_file(filePath + ".XXXXXX")
+{
+    m_file.setAutoRemove(false);
+}
+
+MappedImage::~MappedImage()
+{
+    discard();
+}
+
+bool MappedImage::isMappable(const QString& filePath)
+{
+    Layout layout = RAW;
+    return fileLayout(filePath, layout);
+}
+
+QImage::Format MappedImage::fileFormat(const QString& filePath, QImage::Format format)
+{
+    Layout layout = RAW;
+    if (!fileLayout(filePath, layout)) {
+        return QImage::Format_Invalid;
+    }
+
+    switch (layout) {
+        case RAW:
+            // indices mean nothing without the palette, which raw files do not have
+            return format == QImage::Format_Indexed8 ? QImage::Format_RGB888 : format;
+
+        case PPM:
+            return QImage::Format_RGB888;
+
+        case PGM:
+            return QImage::Format_Grayscale8;
+
+        case BMP:
+            return format == QImage::Format_Indexed8 || format == QImage::Format_Grayscale8 ? format : QImage::Format_BGR888;
+    }
+    return QImage::Format_Invalid;
+}
+
+bool MappedImage::create(int width, int height, QImage::Format format, const QVector<QRgb>& colorTable)
+{
+    Layout layout = RAW;
+    if (m_data || width <= 0 || height <= 0 || format == QImage::Format_Invalid || !fileLayout(m_filePath, layout) ||
+        (layout == RAW && format == QImage::Format_Indexed8)) {
+        return false;
+    }
+
+    // netpbm and raw rows are tightly packed, BMP rows are padded to 4 bytes
+    const int bitsPerPixel = QImage::toPixelFormat(format).bitsPerPixel();
+    const qint64 packedLine = (static_cast<qint64>(width) * bitsPerPixel + 7) / 8;
+    const qint64 bytesPerLine = layout == BMP ? (packedLine + 3) / 4 * 4 : packedLine;
+    if (bytesPerLine > std::numeric_limits<int>::max()) {
+        return false;
+    }
+
+    QByteArray header;
+    switch (layout) {
+        case RAW:
+            break;
+
+        case PPM:
+        case PGM:
+            header = netpbmHeader(layout, width, height);
+            break;
+
+        case BMP:
+            header = bmpHeader(width, height, format, colorTable, static_cast<int>(bytesPerLine));
+            if (header.isEmpty()) {
+                return false;
+            }
+            break;
+    }
+
+    Profiler::Scope scope {"map"};
+    m_size = header.size() + bytesPerLine * height;
+
+    // the destination is replaced by the complete file only, so it is never seen half written
+    if (!m_file.open()) {
+        return false;
+    }
+    m_temporaryPath = m_file.fileName();
+    m_file.setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner | QFileDevice::ReadGroup | QFileDevice::ReadOther);
+
+    if (!m_file.resize(m_size)) {
+        discard();
+        return false;
+    }
+
+    m_data = m_file.map(0, m_size);
+    if (!m_data) {
+        discard();
+        return false;
+    }
+
+    std::memcpy(m_data, header.constData(), static_cast<size_t>(header.size()));
+    m_image = QImage{m_data + header.size(), width, height, static_cast<int>(bytesPerLine), format};
+    m_image.setColorTable(colorTable);
+    return !m_image.isNull();
+}
+
+bool MappedImage::finish(bool sync)
+{
+    if (!m_data) {
+        return false;
+    }
+
+    Profiler::Scope scope {"unmap"};
+    m_image = QImage{};
+    bool ok = true;
+
+#ifdef Q_OS_UNIX
+    if (sync) {
+        ok = ::msync(m_data, static_cast<size_t>(m_size), MS_SYNC) == 0 && ::fsync(m_file.handle()) == 0;
+    }
+#else
+    // mapped pages are written back by the system whenever it decides to
+    Q_UNUSED(sync)
+#endif
+
+    ok = m_file.unmap(m_data) && ok;
+    m_data = nullptr;
+    m_file.close();
+
+    // a new file rather than writing through a hardlink someone else holds
+    if (ok) {
+        QFile::remove(m_filePath);
+        ok = QFile::rename(m_temporaryPath, m_filePath);
+    }
+
+    if (ok) {
+        m_temporaryPath.clear();
+    } else {
+        discard();
+    }
+    return ok;
+}
+
+void MappedImage::discard()
+{
+    m_image = QImage{};
+    if (m_data) {
+        m_file.unmap(m_data);
+        m_data = nullptr;
+    }
+    m_file.close();
+
+    if (!m_temporaryPath.isEmpty()) {
+        QFile::remove(m_temporaryPath);
+        m_temporaryPath.clear();
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <QImage>
+#include <QString>
+#include <QTemporaryFile>
+
+/**
+ * Image file created at its final size and mapped into memory, with a QImage
+ * wrapped around the mapped pixels: rendering writes straight into the page
+ * cache, there is neither an encoder nor a write() copy.
+ *
+ * Files are raw pixels without a header (".raw"), binary PPM/PGM (".ppm", ".pgm")
+ * or top-down BMP (".bmp"). Headers are padded, so the pixels of every file start
+ * at a PIXELS_ALIGNMENT boundary.
+ *
+ * The mapping is a temporary file next to the destination, renamed into place by a
+ * successful finish(): a failed or abandoned render leaves no partial image behind.
+ */
+class MappedImage
+{
+public:
+    static const int PIXELS_ALIGNMENT = 64;
+
+    explicit MappedImage(const QString& filePath);
+    ~MappedImage();
+
+    MappedImage(const MappedImage&) = delete;
+    MappedImage& operator=(const MappedImage&) = delete;
+
+    /**
+     * @brief isMappable - checks whether files of 'filePath' type can be rendered in place
+     */
+    static bool isMappable(const QString& filePath);
+
+    /**
+     * @brief fileFormat - pixel format a file of 'filePath' type stores pattern pixels
+     *                     rendered in 'format' in: raw files keep it, but for Indexed8
+     *                     which has no palette there and is RGB888, PPM is RGB888,
+     *                     PGM Grayscale8 and BMP BGR888 unless it is an 8-bit format
+     */
+    static QImage::Format fileFormat(const QString& filePath, QImage::Format format);
+
+    /**
+     * @brief create - creates the file holding 'width' x 'height' pixels of 'format',
+     *                 writes its header and maps it, 'colorTable' is used for indexed formats
+     */
+    bool create(int width, int height, QImage::Format format, const QVector<QRgb>& colorTable = {});
+
+    /**
+     * @brief image - mapped pixels, valid between create() and finish()
+     */
+    QImage& image() { return m_image; }
+
+    /**
+     * @brief finish - unmaps the file and moves it to its destination
+     * @param sync - flushes mapped pages and the file to the disk before returning
+     */
+    bool finish(bool sync);
+
+private:
+    void discard();
+
+    QString m_filePath;
+    QTemporaryFile m_file;
+    QString m_temporaryPath; // until renamed into place
+    uchar* m_data = nullptr;
+    qint64 m_size = 0;
+    QImage m_image;
+};
@@ -0,0 +1,127 @@
+#include "PatternBackends.h"
+#include "GlyphAtlas.h"
+#include "StampCache.h"
+
+#include <QLinearGradient>
+#include <QPainter>
+
+namespace {
+
+QPen makePen(QRgb color, qreal width)
+{
+    return QPen{QBrush{QColor::fromRgba(color)}, width};
+}
+
+} // namespace
+
+PainterBackend::PainterBackend(QPainter& painter, const Options& options)
+    : m_painter(painter)
+    , m_options(options)
+{}
+
+void PainterBackend::drawRect(const QRectF& rect, QRgb fill, QRgb pen, qreal penWidth, bool repeated)
+{
+    const auto paint = [=](QPainter& painter, const QRectF& target) {
+        painter.setPen(makePen(pen, penWidth));
+        painter.setBrush(QBrush{QColor::fromRgba(fill)});
+        painter.drawRect(target);
+    };
+
+    if (!repeated || !m_options.stamps) {
+        paint(m_painter, rect);
+        return;
+    }
+    StampCache::Parameter parameter;
+    parameter.fill = fill;
+    parameter.pen = pen;
+    parameter.penWidth = penWidth;
+    StampCache::draw(m_painter, StampCache::RECT, rect, rect, parameter, paint);
+}
+
+void PainterBackend::drawShadedRect(const QRectF& rect, QRgb color, bool repeated)
+{
+    const auto paint = [=](QPainter& painter, const QRectF& target) {
+        painter.setPen(Qt::transparent);
+        painter.setBrush(QBrush{QColor::fromRgba(color)});
+        painter.drawRect(target);
+
+        QLinearGradient gradient {target.topLeft(), target.bottomRight()};
+        gradient.setColorAt(0, Qt::transparent);
+        gradient.setColorAt(1, Qt::black);
+
+        QBrush gradientBrush{gradient};
+        gradientBrush.setStyle(Qt::BrushStyle::LinearGradientPattern);
+        painter.setBrush(gradientBrush);
+        painter.drawRect(target);
+    };
+
+    if (!repeated || !m_options.stamps) {
+        paint(m_painter, rect);
+        return;
+    }
+    StampCache::Parameter parameter;
+    parameter.fill = color;
+    StampCache::draw(m_painter, StampCache::SHADED_RECT, rect, rect, parameter, paint);
+}
+
+void PainterBackend::drawText(const QRectF& rect, int flags, const QString& text, const QString& fontFamily, int pixelSize, QRgb color)
+{
+    if (m_options.glyphAtlas && GlyphAtlas::canBlit(text)) {
+        glyphs(fontFamily, pixelSize, color).draw(m_painter, rect, flags, text);
+        return;
+    }
+
+    // the font of the atlas, without rendering an atlas which would not be blitted
+    QFont font {fontFamily};
+    font.setPixelSize(qMax(1, pixelSize));
+    m_painter.setFont(font);
+    m_painter.setPen(QColor::fromRgba(color));
+    m_painter.drawText(rect, flags, text);
+}
+
+void PainterBackend::drawLattice(const QRectF& rect, int rows, int columns, qreal cellHeight, QRgb pen, qreal penWidth, bool repeated)
+{
+    if (rows <= 0 || columns <= 0) {
+        return;
+    }
+
+    const qreal cellWidth = rect.width() / columns;
+    const auto paint = [=](QPainter& painter, const QRectF& target) {
+        painter.setBrush(QBrush{Qt::transparent});
+        painter.setPen(makePen(pen, penWidth));
+
+        for (int k = 0; k < rows; ++k) {
+            qreal xCell = k == 0 ? target.x() + cellWidth / 2 : target.x();
+            const qreal yCell = target.y() + k * cellHeight;
+
+            for (int z = 0; z < columns; ++z) {
+                painter.drawRect(QRectF{xCell, yCell, cellWidth, cellHeight});
+                xCell += cellWidth;
+            }
+        }
+    };
+
+    if (!repeated || !m_options.stamps) {
+        paint(m_painter, rect);
+        return;
+    }
+
+    // the first row sticks out by half a cell
+    const QRectF bounds = rect.adjusted(0, 0, cellWidth / 2, 0);
+    StampCache::Parameter parameter;
+    parameter.pen = pen;
+    parameter.penWidth = penWidth;
+    parameter.rows = rows;
+    parameter.columns = columns;
+    parameter.cellHeight = cellHeight;
+    StampCache::draw(m_painter, StampCache::LATTICE, rect, bounds, parameter, paint);
+}
+
+const GlyphAtlas& PainterBackend::glyphs(const QString& fontFamily, int pixelSize, QRgb color)
+{
+    auto& atlas = m_glyphs[std::make_tuple(fontFamily, pixelSize, color)];
+    if (!atlas) {
+        atlas = GlyphAtlas::get(fontFamily, pixelSize, color);
+    }
+    return *atlas;
+}
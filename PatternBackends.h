@@ -0,0 +1,82 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <tuple>
+
+#include <QImage>
+#include <QPoint>
+
+#include "DisplayList.h"
+#include "RasterKernels.h"
+
+class GlyphAtlas;
+class QPainter;
+
+/**
+ * Replays display lists with QPainter, on raster images as well as on vector
+ * devices such as QPdfWriter or QSvgGenerator.
+ */
+class PainterBackend : public DisplayListBackend
+{
+public:
+    struct Options
+    {
+        bool glyphAtlas = true; // blit numeric labels from pre-rendered digits
+        bool stamps = true;     // composite repeated primitives from stamps, raster devices only
+    };
+
+    PainterBackend(QPainter& painter, const Options& options);
+
+    void drawRect(const QRectF& rect, QRgb fill, QRgb pen, qreal penWidth, bool repeated) override;
+    void drawShadedRect(const QRectF& rect, QRgb color, bool repeated) override;
+    void drawText(const QRectF& rect, int flags, const QString& text, const QString& fontFamily, int pixelSize, QRgb color) override;
+    void drawLattice(const QRectF& rect, int rows, int columns, qreal cellHeight, QRgb pen, qreal penWidth, bool repeated) override;
+
+private:
+    const GlyphAtlas& glyphs(const QString& fontFamily, int pixelSize, QRgb color);
+
+    QPainter& m_painter;
+    Options m_options;
+    std::map<std::tuple<QString, int, QRgb>, std::shared_ptr<const GlyphAtlas>> m_glyphs;
+};
+
+/**
+ * Writes display lists of opaque rectangles straight into the scanlines of an image
+ * with RasterKernels: same pixel coverage as QPainter, shading within
+ * RasterKernels::SHADE_TOLERANCE of the gradient QPainter paints. 'Pixels' is the
+ * span writer of the image format, see RasterKernels::withPixels().
+ */
+template <typename Pixels>
+class RasterBackend : public DisplayListBackend
+{
+public:
+    /**
+     * @param image - target of a format written by 'Pixels'
+     * @param origin - list position of the top-left image pixel
+     */
+    RasterBackend(QImage& image, const QPoint& origin)
+        : m_image(image)
+        , m_origin(origin)
+    {}
+
+    void drawRect(const QRectF& rect, QRgb fill, QRgb, qreal, bool) override
+    {
+        // rasterizable lists have opaque rects without an outline
+        RasterKernels::fillRect<Pixels>(m_image, RasterKernels::toFillRect(rect.translated(-m_origin)), fill);
+    }
+
+    void drawShadedRect(const QRectF& rect, QRgb color, bool) override
+    {
+        const QRectF deviceRect = rect.translated(-m_origin);
+        RasterKernels::fillShadedRect<Pixels>(m_image, RasterKernels::toFillRect(deviceRect), deviceRect, color);
+    }
+
+    // never part of a rasterizable list
+    void drawText(const QRectF&, int, const QString&, const QString&, int, QRgb) override {}
+    void drawLattice(const QRectF&, int, int, qreal, QRgb, qreal, bool) override {}
+
+private:
+    QImage& m_image;
+    QPointF m_origin;
+};
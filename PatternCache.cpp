@@ -0,0 +1,121 @@
+#include "PatternCache.h"
+#include "CalibrationFactory.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QUuid>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+namespace {
+
+const QString TEMP_PREFIX = ".tmp-";
+
+bool linkOrCopy(const QString& source, const QString& destination)
+{
+    QFile::remove(destination);
+
+#ifdef Q_OS_UNIX
+    if (::link(QFile::encodeName(source).constData(), QFile::encodeName(destination).constData()) == 0) {
+        return true;
+    }
+#endif
+    return QFile::copy(source, destination);
+}
+
+} // namespace
+
+PatternCache::PatternCache(const QString& directory, qint64 maxBytes)
+    : m_directory(directory)
+    , m_maxBytes(maxBytes)
+{
+    m_valid = QDir{}.mkpath(m_directory);
+}
+
+QString PatternCache::hash(const Key& key)
+{
+    const QString description = QString{"%1|%2|%3|%4|%5|%6|%7|%8|%9|%10"}
+            .arg(key.type).arg(key.width).arg(key.height).arg(key.rows).arg(key.columns)
+            .arg(key.views).arg(key.viewIndex).arg(key.format.toLower(), CalibrationFactory::generatorVersion(), key.encoder);
+
+    return QCryptographicHash::hash(description.toUtf8(), QCryptographicHash::Sha256).toHex();
+}
+
+bool PatternCache::fetch(const QString& hash, const QString& destination) const
+{
+    Profiler::Scope scope {"cache fetch"};
+    const QString path = entryPath(hash);
+    if (!m_valid || !QFileInfo::exists(path) || !linkOrCopy(path, destination)) {
+        return false;
+    }
+
+    // modification time orders entries for eviction
+    QFile entry {path};
+    if (entry.open(QIODevice::ReadOnly)) {
+        entry.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+    }
+    return true;
+}
+
+bool PatternCache::insert(const QString& hash, const QString& source) const
+{
+    Profiler::Scope scope {"cache insert"};
+    if (!m_valid) {
+        return false;
+    }
+
+    const QString path = entryPath(hash);
+    const QString tempPath = QDir{m_directory}.filePath(TEMP_PREFIX + hash + "-" + QUuid::createUuid().toString(QUuid::Id128));
+    if (!QFile::copy(source, tempPath)) {
+        return false;
+    }
+
+    // rename replaces the entry atomically, readers see either no file or a complete one
+    if (std::rename(QFile::encodeName(tempPath).constData(), QFile::encodeName(path).constData()) != 0) {
+        QFile::remove(tempPath);
+        return QFileInfo::exists(path);
+    }
+
+    evict();
+    return true;
+}
+
+QString PatternCache::entryPath(const QString& hash) const
+{
+    return QDir{m_directory}.filePath(hash);
+}
+
+void PatternCache::evict() const
+{
+    QFileInfoList entries = QDir{m_directory}.entryInfoList(QDir::Files | QDir::Hidden);
+    entries.erase(std::remove_if(entries.begin(), entries.end(), [](const QFileInfo& info) {
+        return info.fileName().startsWith(TEMP_PREFIX);
+    }), entries.end());
+
+    qint64 totalBytes = 0;
+    for (const auto& entry : entries) {
+        totalBytes += entry.size();
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const QFileInfo& a, const QFileInfo& b) {
+        return a.lastModified() < b.lastModified();
+    });
+
+    // another process may evict the same entries, failed removals are fine
+    for (const auto& entry : entries) {
+        if (totalBytes <= m_maxBytes) {
+            break;
+        }
+        QFile::remove(entry.filePath());
+        totalBytes -= entry.size();
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <QString>
+
+/**
+ * Content addressed store of generated pattern files. Entries are named by a
+ * hash of everything that defines the output, inserted atomically with a
+ * rename, so concurrent processes can share one directory, and evicted in
+ * least recently used order once the directory exceeds its size limit.
+ */
+class PatternCache
+{
+public:
+    struct Key
+    {
+        int type = 0;
+        int width = 0;
+        int height = 0;
+        int rows = 0;
+        int columns = 0;
+        int views = 0;
+        int viewIndex = 0;
+        QString format; // output file suffix
+        QString encoder; // ImageEncoder::describe of the output encoder
+    };
+
+    /**
+     * @brief PatternCache - opens cache in 'directory', creates it if needed
+     * @param directory - cache directory
+     * @param maxBytes - size of stored files above which old entries are evicted
+     */
+    PatternCache(const QString& directory, qint64 maxBytes);
+
+    bool isValid() const { return m_valid; }
+
+    /**
+     * @brief hash - content address of output described by 'key' for this generator version
+     */
+    static QString hash(const Key& key);
+
+    /**
+     * @brief fetch - hardlinks or copies entry to 'destination' and marks it recently used
+     * @return false on cache miss
+     */
+    bool fetch(const QString& hash, const QString& destination) const;
+
+    /**
+     * @brief insert - stores copy of 'source' under 'hash' and evicts old entries if needed
+     * @return true if entry is in the cache afterwards
+     */
+    bool insert(const QString& hash, const QString& source) const;
+
+private:
+    QString entryPath(const QString& hash) const;
+    void evict() const;
+
+    QString m_directory;
+    qint64 m_maxBytes;
+    bool m_valid = false;
+};
@@ -0,0 +1,244 @@
+#include "PatternServer.h"
+#include "Profiler.h"
+
+#include <cstring>
+
+#include <QElapsedTimer>
+#include <QImage>
+#include <QJsonDocument>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QSharedMemory>
+
+namespace {
+
+const QString SHARED_MEMORY_PREFIX = "shm:";
+
+// rendering a large set of views may take a while, the reply is awaited that long
+const int REPLY_TIMEOUT_MS = 10 * 60 * 1000;
+const int CONNECT_TIMEOUT_MS = 5000;
+
+// a client sending more than this without a line break is not speaking the protocol
+const int MAX_REQUEST_SIZE = 64 * 1024;
+
+static_assert(sizeof(PatternServer::SharedImageHeader) <= PatternServer::SHARED_PIXELS_OFFSET,
+              "shared image header overlaps pixels");
+
+int bytesPerLine(QImage::Format format, int width)
+{
+    // the scanline alignment QImage uses, so the pixels can be wrapped in a QImage as they are
+    const int bitsPerPixel = QImage::toPixelFormat(format).bitsPerPixel();
+    return static_cast<int>((static_cast<qint64>(width) * bitsPerPixel + 31) / 32 * 4);
+}
+
+QByteArray reply(bool ok, const QString& error, qint64 ms)
+{
+    const QJsonObject object {
+        {"ok", ok},
+        {"error", error},
+        {"ms", ms}
+    };
+    return QJsonDocument{object}.toJson(QJsonDocument::Compact) + '\n';
+}
+
+} // namespace
+
+PatternServer::PatternServer(const QString& name, const JobHandler& handler)
+    : m_server(new QLocalServer)
+    , m_name(name)
+    , m_handler(handler)
+{
+    QObject::connect(m_server.get(), &QLocalServer::newConnection, [this] { onNewConnection(); });
+}
+
+PatternServer::~PatternServer() = default;
+
+bool PatternServer::listen(QString& error)
+{
+    // a socket file left by a killed server would make listening fail, but the socket
+    // of a server still running is not taken over
+    QLocalSocket probe;
+    probe.connectToServer(m_name);
+    if (probe.waitForConnected(CONNECT_TIMEOUT_MS)) {
+        error = QString{"another server is listening at %1"}.arg(m_name);
+        return false;
+    }
+    QLocalServer::removeServer(m_name);
+
+    // clients make the server write files with its rights, so only its user may connect
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    if (!m_server->listen(m_name)) {
+        error = m_server->errorString();
+        return false;
+    }
+    return true;
+}
+
+void PatternServer::onNewConnection()
+{
+    while (QLocalSocket* socket = m_server->nextPendingConnection()) {
+        m_pending[socket] = {};
+        QObject::connect(socket, &QLocalSocket::readyRead, [this, socket] { onReadyRead(socket); });
+        QObject::connect(socket, &QLocalSocket::disconnected, [this, socket] {
+            m_pending.erase(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void PatternServer::onReadyRead(QLocalSocket* socket)
+{
+    auto& pending = m_pending[socket];
+    pending += socket->readAll();
+
+    for (int end = pending.indexOf('\n'); end >= 0; end = pending.indexOf('\n')) {
+        const QByteArray line = pending.left(end);
+        pending.remove(0, end + 1);
+        socket->write(handle(line));
+    }
+
+    if (pending.size() > MAX_REQUEST_SIZE) {
+        socket->write(reply(false, "request too long", 0));
+        socket->disconnectFromServer();
+    }
+}
+
+QByteArray PatternServer::handle(const QByteArray& line)
+{
+    Profiler::Scope scope {"request"};
+    QElapsedTimer timer;
+    timer.start();
+
+    QJsonParseError parseError;
+    const QJsonDocument document = QJsonDocument::fromJson(line, &parseError);
+    if (!document.isObject()) {
+        return reply(false, parseError.errorString(), timer.elapsed());
+    }
+
+    BatchManifest::Job job;
+    QString error;
+    if (!BatchManifest::fromJson(document.object(), BatchManifest::Job{}, job, error)) {
+        return reply(false, error, timer.elapsed());
+    }
+
+    const bool ok = m_handler(job, error);
+    return reply(ok, error, timer.elapsed());
+}
+
+bool PatternServer::request(const QString& name, const BatchManifest::Job& job, QString& error)
+{
+    QLocalSocket socket;
+    socket.connectToServer(name);
+    if (!socket.waitForConnected(CONNECT_TIMEOUT_MS)) {
+        error = socket.errorString();
+        return false;
+    }
+
+    socket.write(QJsonDocument{BatchManifest::toJson(job)}.toJson(QJsonDocument::Compact) + '\n');
+    if (!socket.waitForBytesWritten(CONNECT_TIMEOUT_MS)) {
+        error = socket.errorString();
+        return false;
+    }
+
+    QByteArray line;
+    while (!line.contains('\n')) {
+        if (!socket.waitForReadyRead(REPLY_TIMEOUT_MS)) {
+            error = socket.errorString();
+            return false;
+        }
+        line += socket.readAll();
+    }
+
+    const QJsonObject answer = QJsonDocument::fromJson(line.left(line.indexOf('\n'))).object();
+    error = answer.value("error").toString();
+    return answer.value("ok").toBool();
+}
+
+bool PatternServer::isSharedMemory(const QString& destination)
+{
+    return destination.startsWith(SHARED_MEMORY_PREFIX);
+}
+
+QString PatternServer::sharedMemoryKey(const QString& destination)
+{
+    return destination.mid(SHARED_MEMORY_PREFIX.size());
+}
+
+qint64 PatternServer::sharedMemorySize(CalibrationFactory::PatternType type, int width, int height, int views)
+{
+    const qint64 viewSize = static_cast<qint64>(bytesPerLine(CalibrationFactory::patternFormat(type), width)) * height;
+    return SHARED_PIXELS_OFFSET + viewSize * qMax(1, views);
+}
+
+bool PatternServer::renderShared(const QString& destination, CalibrationFactory::PatternType type, int width, int height,
+                                 int rows, int columns, int views, QString& error)
+{
+    QSharedMemory memory {sharedMemoryKey(destination)};
+    if (!memory.attach()) {
+        error = memory.errorString();
+        return false;
+    }
+
+    if (memory.size() < sharedMemorySize(type, width, height, views)) {
+        error = QString{"shared memory of %1 bytes is expected"}.arg(sharedMemorySize(type, width, height, views));
+        return false;
+    }
+
+    const QImage::Format format = CalibrationFactory::patternFormat(type);
+    const int stride = bytesPerLine(format, width);
+    const qint64 viewSize = static_cast<qint64>(stride) * height;
+
+    if (!memory.lock()) {
+        error = memory.errorString();
+        return false;
+    }
+
+    auto* data = static_cast<uchar*>(memory.data());
+    const SharedImageHeader header {SHARED_MAGIC, width, height, stride, static_cast<qint32>(format), views};
+    std::memcpy(data, &header, sizeof(header));
+
+    bool ok = true;
+    uchar* pixels = data + SHARED_PIXELS_OFFSET;
+    if (views > 0) {
+        for (int i = 0; i < views && ok; ++i) {
+            ok = CalibrationFactory::renderView(type, pixels + i * viewSize, width, height, stride, format, views, i);
+        }
+    } else {
+        ok = CalibrationFactory::renderPattern(type, pixels, width, height, stride, format, rows, columns);
+    }
+
+    memory.unlock();
+    if (!ok) {
+        error = "rendering failed";
+    }
+    return ok;
+}
+
+bool PatternServer::checkShared(QSharedMemory& memory, CalibrationFactory::PatternType type, int width, int height,
+                                int views, QString& error)
+{
+    const qint64 expectedSize = sharedMemorySize(type, width, height, views);
+    if (memory.size() < expectedSize) {
+        error = QString{"shared memory holds %1 bytes, %2 are expected"}.arg(memory.size()).arg(expectedSize);
+        return false;
+    }
+
+    if (!memory.lock()) {
+        error = memory.errorString();
+        return false;
+    }
+    SharedImageHeader header;
+    std::memcpy(&header, memory.constData(), sizeof(header));
+    memory.unlock();
+
+    const QImage::Format format = CalibrationFactory::patternFormat(type);
+    if (header.magic != SHARED_MAGIC || header.width != width || header.height != height ||
+        header.bytesPerLine != bytesPerLine(format, width) || header.format != static_cast<qint32>(format) ||
+        header.views != views) {
+        error = QString{"shared image is %1x%2, %3 views of format %4 and %5 bytes per line, %6x%7, %8 views of format %9 and %10 bytes per line are expected"}
+                .arg(header.width).arg(header.height).arg(header.views).arg(header.format).arg(header.bytesPerLine)
+                .arg(width).arg(height).arg(views).arg(static_cast<int>(format)).arg(bytesPerLine(format, width));
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+
+#include <QString>
+
+#include "BatchManifest.h"
+#include "CalibrationFactory.h"
+
+class QLocalServer;
+class QLocalSocket;
+class QSharedMemory;
+
+/**
+ * Long running process answering pattern requests over a local socket, so fonts,
+ * glyph atlases, stamps and worker threads stay warm between requests.
+ *
+ * Every request is a single line of JSON job as in BatchManifest, every reply a
+ * single line {"ok": bool, "error": string, "ms": int}. A destination "shm:KEY"
+ * names a shared memory segment created by the client, see SharedImageHeader.
+ */
+class PatternServer
+{
+public:
+    /**
+     * Start of a shared memory destination. Views follow one another from
+     * SHARED_PIXELS_OFFSET on, each of them 'height' scanlines 'bytesPerLine' apart.
+     */
+    struct SharedImageHeader
+    {
+        quint32 magic;
+        qint32 width;
+        qint32 height;
+        qint32 bytesPerLine;
+        qint32 format; // QImage::Format, Indexed8 pixels are green intensities
+        qint32 views;
+    };
+
+    static const quint32 SHARED_MAGIC = 0x43494d47; // "CIMG"
+    static const int SHARED_PIXELS_OFFSET = 64;
+
+    /**
+     * @brief JobHandler - generates 'job', returns false and sets 'error' on failure
+     */
+    using JobHandler = std::function<bool(const BatchManifest::Job& job, QString& error)>;
+
+    /**
+     * @brief PatternServer - server handing received jobs to 'handler'
+     * @param name - socket name or absolute path of the socket file
+     */
+    PatternServer(const QString& name, const JobHandler& handler);
+    ~PatternServer();
+
+    PatternServer(const PatternServer&) = delete;
+    PatternServer& operator=(const PatternServer&) = delete;
+
+    /**
+     * @brief listen - starts accepting clients of the same user only, a stale socket of
+     *                 the same name is replaced, one a server still answers on is not
+     */
+    bool listen(QString& error);
+
+    /**
+     * @brief request - sends 'job' to the server 'name' and waits for its reply
+     * @return true if the server generated the pattern
+     */
+    static bool request(const QString& name, const BatchManifest::Job& job, QString& error);
+
+    static bool isSharedMemory(const QString& destination);
+
+    /**
+     * @brief sharedMemoryKey - QSharedMemory key of a shared memory destination
+     */
+    static QString sharedMemoryKey(const QString& destination);
+
+    /**
+     * @brief sharedMemorySize - bytes a shared memory destination needs for the pattern
+     */
+    static qint64 sharedMemorySize(CalibrationFactory::PatternType type, int width, int height, int views);
+
+    /**
+     * @brief renderShared - renders pattern, or its 'views' views if views > 0, into the
+     *                       shared memory segment named by 'destination'
+     */
+    static bool renderShared(const QString& destination, CalibrationFactory::PatternType type, int width, int height,
+                             int rows, int columns, int views, QString& error);
+
+    /**
+     * @brief checkShared - checks that 'memory' holds what renderShared() writes for the
+     *                      pattern of 'type', size and 'views' requested by the client
+     */
+    static bool checkShared(QSharedMemory& memory, CalibrationFactory::PatternType type, int width, int height,
+                            int views, QString& error);
+
+private:
+    void onNewConnection();
+    void onReadyRead(QLocalSocket* socket);
+    QByteArray handle(const QByteArray& line);
+
+    std::unique_ptr<QLocalServer> m_server;
+    QString m_name;
+    JobHandler m_handler;
+    std::map<QLocalSocket*, QByteArray> m_pending; // partial request line of every client
+};
@@ -0,0 +1,228 @@
+#include "PngStreamWriter.h"
+
+#include <QIODevice>
+#include <QtEndian>
+
+namespace {
+
+const uchar PNG_SIGNATURE[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+const uchar FILTER_UP = 2;
+const size_t OUTPUT_CHUNK_SIZE = 1 << 16;
+
+} // namespace
+
+PngStreamWriter::PngStreamWriter(QIODevice* device, int compressionLevel, int strategy)
+    : m_device(device)
+    , m_compressionLevel(compressionLevel)
+    , m_strategy(strategy)
+{}
+
+PngStreamWriter::~PngStreamWriter()
+{
+    if (m_streamReady) {
+        deflateEnd(&m_stream);
+    }
+}
+
+bool PngStreamWriter::begin(int width, int height, QImage::Format format, const QVector<QRgb>& colorTable)
+{
+    if (!m_device || width <= 0 || height <= 0 || m_streamReady) {
+        return false;
+    }
+
+    m_width = width;
+    m_height = height;
+    m_format = format;
+
+    switch (format) {
+        case QImage::Format_RGB32:
+        case QImage::Format_RGB888:
+            m_colorType = RGB;
+            m_bytesPerPixel = 3;
+            break;
+
+        case QImage::Format_Grayscale8:
+            m_colorType = GRAY;
+            m_bytesPerPixel = 1;
+            break;
+
+        case QImage::Format_Indexed8:
+            m_colorType = PALETTE;
+            m_bytesPerPixel = 1;
+            break;
+
+        default:
+            // everything else goes through ARGB32
+            m_format = QImage::Format_ARGB32;
+            m_colorType = RGBA;
+            m_bytesPerPixel = 4;
+            break;
+    }
+
+    if (m_colorType == PALETTE && (colorTable.isEmpty() || colorTable.size() > 256)) {
+        return false;
+    }
+
+    if (deflateInit2(&m_stream, m_compressionLevel, Z_DEFLATED, MAX_WBITS, 9, m_strategy) != Z_OK) {
+        return false;
+    }
+    m_streamReady = true;
+
+    const size_t rowSize = 1 + static_cast<size_t>(m_width) * m_bytesPerPixel;
+    m_row.assign(rowSize, 0);
+    m_previousRow.assign(rowSize, 0);
+    m_filteredRow.assign(rowSize, 0);
+    m_output.resize(OUTPUT_CHUNK_SIZE);
+
+    uchar header[13];
+    qToBigEndian<quint32>(m_width, header);
+    qToBigEndian<quint32>(m_height, header + 4);
+    header[8] = 8; // bit depth
+    header[9] = m_colorType;
+    header[10] = 0; // deflate
+    header[11] = 0; // adaptive filtering
+    header[12] = 0; // no interlace
+
+    if (m_device->write(reinterpret_cast<const char*>(PNG_SIGNATURE), sizeof(PNG_SIGNATURE)) != sizeof(PNG_SIGNATURE) ||
+        !writeChunk("IHDR", header, sizeof(header))) {
+        return false;
+    }
+
+    if (m_colorType == PALETTE) {
+        std::vector<uchar> palette;
+        std::vector<uchar> alpha;
+        bool hasAlpha = false;
+        for (const QRgb color : colorTable) {
+            palette.insert(palette.end(), {static_cast<uchar>(qRed(color)), static_cast<uchar>(qGreen(color)),
+                                           static_cast<uchar>(qBlue(color))});
+            alpha.push_back(static_cast<uchar>(qAlpha(color)));
+            hasAlpha = hasAlpha || qAlpha(color) != 255;
+        }
+
+        if (!writeChunk("PLTE", palette.data(), palette.size()) ||
+            (hasAlpha && !writeChunk("tRNS", alpha.data(), alpha.size()))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PngStreamWriter::writeRows(const QImage& band)
+{
+    if (!m_streamReady || m_failed || band.width() != m_width || m_rowsWritten + band.height() > m_height) {
+        return false;
+    }
+
+    const QImage source = band.format() == m_format ? band : band.convertToFormat(m_format);
+    for (int y = 0; y < source.height(); ++y) {
+        convertRow(source.constScanLine(y));
+
+        // "up" filter: runs of equal rows, which these patterns are made of, turn into zeros
+        m_filteredRow[0] = FILTER_UP;
+        for (size_t i = 1; i < m_row.size(); ++i) {
+            m_filteredRow[i] = static_cast<uchar>(m_row[i] - m_previousRow[i]);
+        }
+        std::swap(m_row, m_previousRow);
+
+        m_stream.next_in = m_filteredRow.data();
+        m_stream.avail_in = static_cast<uInt>(m_filteredRow.size());
+        if (!deflateRow(Z_NO_FLUSH)) {
+            return false;
+        }
+        ++m_rowsWritten;
+    }
+    return true;
+}
+
+bool PngStreamWriter::finish()
+{
+    if (!m_streamReady || m_failed || m_rowsWritten != m_height) {
+        return false;
+    }
+
+    m_stream.next_in = nullptr;
+    m_stream.avail_in = 0;
+    return deflateRow(Z_FINISH) && writeChunk("IEND", nullptr, 0);
+}
+
+bool PngStreamWriter::writeChunk(const char* type, const uchar* data, size_t size)
+{
+    uchar length[4];
+    qToBigEndian<quint32>(static_cast<quint32>(size), length);
+
+    uLong crc = crc32(0, reinterpret_cast<const Bytef*>(type), 4);
+    if (size > 0) {
+        crc = crc32(crc, data, static_cast<uInt>(size));
+    }
+    uchar crcBytes[4];
+    qToBigEndian<quint32>(static_cast<quint32>(crc), crcBytes);
+
+    if (m_device->write(reinterpret_cast<const char*>(length), 4) != 4 ||
+        m_device->write(type, 4) != 4 ||
+        (size > 0 && m_device->write(reinterpret_cast<const char*>(data), static_cast<qint64>(size)) != static_cast<qint64>(size)) ||
+        m_device->write(reinterpret_cast<const char*>(crcBytes), 4) != 4) {
+        m_failed = true;
+        return false;
+    }
+    return true;
+}
+
+bool PngStreamWriter::deflateRow(int flush)
+{
+    // full output buffers become IDAT chunks as soon as they are filled
+    for (;;) {
+        m_stream.next_out = m_output.data();
+        m_stream.avail_out = static_cast<uInt>(m_output.size());
+
+        const int result = deflate(&m_stream, flush);
+        if (result == Z_STREAM_ERROR) {
+            m_failed = true;
+            return false;
+        }
+
+        const size_t produced = m_output.size() - m_stream.avail_out;
+        if (produced > 0 && !writeChunk("IDAT", m_output.data(), produced)) {
+            return false;
+        }
+
+        if (flush == Z_FINISH ? result == Z_STREAM_END : m_stream.avail_out != 0) {
+            return true;
+        }
+    }
+}
+
+void PngStreamWriter::convertRow(const uchar* source)
+{
+    uchar* row = m_row.data() + 1;
+
+    switch (m_format) {
+        case QImage::Format_RGB888:
+        case QImage::Format_Grayscale8:
+        case QImage::Format_Indexed8:
+            std::copy(source, source + static_cast<size_t>(m_width) * m_bytesPerPixel, row);
+            break;
+
+        case QImage::Format_RGB32:
+        {
+            const auto* pixels = reinterpret_cast<const QRgb*>(source);
+            for (int x = 0; x < m_width; ++x, row += 3) {
+                row[0] = static_cast<uchar>(qRed(pixels[x]));
+                row[1] = static_cast<uchar>(qGreen(pixels[x]));
+                row[2] = static_cast<uchar>(qBlue(pixels[x]));
+            }
+            break;
+        }
+
+        default:
+        {
+            const auto* pixels = reinterpret_cast<const QRgb*>(source);
+            for (int x = 0; x < m_width; ++x, row += 4) {
+                row[0] = static_cast<uchar>(qRed(pixels[x]));
+                row[1] = static_cast<uchar>(qGreen(pixels[x]));
+                row[2] = static_cast<uchar>(qBlue(pixels[x]));
+                row[3] = static_cast<uchar>(qAlpha(pixels[x]));
+            }
+            break;
+        }
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vector>
+
+#include <QImage>
+
+#include <zlib.h>
+
+#include "ImageEncoder.h"
+
+class QIODevice;
+
+/**
+ * PNG encoder fed row by row: the header goes out first, then every band of
+ * rows is filtered and deflated in streaming mode and flushed as IDAT chunks,
+ * so an image is never held in memory as a whole.
+ */
+class PngStreamWriter : public ImageEncoder
+{
+public:
+    /**
+     * @brief PngStreamWriter - writer into 'device', which must stay open until finish()
+     * @param compressionLevel - zlib level 0-9 or Z_DEFAULT_COMPRESSION
+     * @param strategy - zlib strategy, Z_RLE suits the long runs of solid colour patterns
+     */
+    explicit PngStreamWriter(QIODevice* device, int compressionLevel = Z_DEFAULT_COMPRESSION, int strategy = Z_DEFAULT_STRATEGY);
+    ~PngStreamWriter() override;
+
+    PngStreamWriter(const PngStreamWriter&) = delete;
+    PngStreamWriter& operator=(const PngStreamWriter&) = delete;
+
+    /**
+     * @brief begin - writes header of 'width' x 'height' image stored with colour type
+     *                matching 'format', 'colorTable' is used for indexed formats
+     */
+    bool begin(int width, int height, QImage::Format format, const QVector<QRgb>& colorTable = {}) override;
+
+    /**
+     * @brief writeRows - appends all rows of 'band', which has to be of image width and format
+     */
+    bool writeRows(const QImage& band) override;
+
+    /**
+     * @brief finish - flushes compressed data and writes the trailer
+     * @return true if the whole image was written
+     */
+    bool finish() override;
+
+private:
+    enum ColorType
+    {
+        GRAY = 0,
+        RGB = 2,
+        PALETTE = 3,
+        RGBA = 6
+    };
+
+    bool writeChunk(const char* type, const uchar* data, size_t size);
+    bool deflateRow(int flush);
+    void convertRow(const uchar* source);
+
+    QIODevice* m_device;
+    int m_compressionLevel;
+    int m_strategy;
+    z_stream m_stream {};
+    bool m_streamReady = false;
+    bool m_failed = false;
+
+    QImage::Format m_format = QImage::Format_Invalid;
+    ColorType m_colorType = RGBA;
+    int m_width = 0;
+    int m_height = 0;
+    int m_rowsWritten = 0;
+    int m_bytesPerPixel = 4;
+
+    // filter type byte followed by pixels, for the current and the previous row
+    std::vector<uchar> m_row;
+    std::vector<uchar> m_previousRow;
+    std::vector<uchar> m_filteredRow;
+    std::vector<uchar> m_output;
+};
@@ -0,0 +1,193 @@
+#include "Profiler.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+
+#include <QCoreApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+#if defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+struct Event
+{
+    const char* name;
+    bool memory;
+    int index;
+    int thread;
+    qint64 startNs;
+    qint64 durationNs;
+    qint64 residentKb;
+    qint64 peakResidentKb;
+};
+
+// a long running process keeps the most recent events only
+const size_t MAX_EVENTS = 1 << 20;
+
+std::atomic<bool> profilingEnabled {false};
+
+std::mutex eventsMutex;
+std::deque<Event> events;
+
+const auto epoch = std::chrono::steady_clock::now();
+
+// nesting of stages on the current thread
+thread_local int depth = 0;
+
+qint64 nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+// small sequential ids read better in a trace viewer than native thread handles
+int threadIndex()
+{
+    static std::atomic<int> nextIndex {0};
+    thread_local const int index = nextIndex++;
+    return index;
+}
+
+qint64 residentKb()
+{
+#if defined(Q_OS_LINUX)
+    long pages = 0;
+    long residentPages = 0;
+    FILE* statm = std::fopen("/proc/self/statm", "r");
+    if (!statm) {
+        return 0;
+    }
+    const bool parsed = std::fscanf(statm, "%ld %ld", &pages, &residentPages) == 2;
+    std::fclose(statm);
+    return parsed ? residentPages * (sysconf(_SC_PAGESIZE) / 1024) : 0;
+#else
+    return 0;
+#endif
+}
+
+qint64 peakResidentKb()
+{
+#if defined(Q_OS_UNIX)
+    rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(Q_OS_MACOS)
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#else
+    return 0;
+#endif
+}
+
+void record(const Event& event)
+{
+    std::lock_guard<std::mutex> lock {eventsMutex};
+    if (events.size() >= MAX_EVENTS) {
+        events.pop_front();
+    }
+    events.push_back(event);
+}
+
+QJsonObject toJson(const Event& event, qint64 pid)
+{
+    QJsonObject json {
+        {"name", event.name},
+        {"pid", pid},
+        {"tid", event.thread},
+        {"ts", event.startNs / 1e3}
+    };
+
+    if (event.memory) {
+        json["ph"] = "C";
+        json["args"] = QJsonObject{{"residentMb", event.residentKb / 1024.0}, {"peakResidentMb", event.peakResidentKb / 1024.0}};
+        return json;
+    }
+
+    json["ph"] = "X";
+    json["dur"] = event.durationNs / 1e3;
+    if (event.index >= 0) {
+        json["args"] = QJsonObject{{"index", event.index}};
+    }
+    return json;
+}
+
+} // namespace
+
+Profiler::Scope::Scope(const char* name, int index)
+    : m_name(name)
+    , m_index(index)
+{
+    if (profilingEnabled.load(std::memory_order_relaxed)) {
+        m_startNs = nowNs();
+        ++depth;
+    }
+}
+
+Profiler::Scope::~Scope()
+{
+    end();
+}
+
+void Profiler::Scope::end()
+{
+    if (m_startNs < 0) {
+        return;
+    }
+
+    record(Event{m_name, false, m_index, threadIndex(), m_startNs, nowNs() - m_startNs, 0, 0});
+    m_startNs = -1;
+
+    if (--depth == 0) {
+        sampleMemory();
+    }
+}
+
+void Profiler::setEnabled(bool enabled)
+{
+    profilingEnabled = enabled;
+}
+
+bool Profiler::isEnabled()
+{
+    return profilingEnabled.load(std::memory_order_relaxed);
+}
+
+void Profiler::sampleMemory()
+{
+    if (!isEnabled()) {
+        return;
+    }
+    record(Event{"memory", true, -1, threadIndex(), nowNs(), 0, residentKb(), peakResidentKb()});
+}
+
+bool Profiler::write(const QString& filePath)
+{
+    const qint64 pid = QCoreApplication::applicationPid();
+
+    QJsonArray traceEvents;
+    {
+        std::lock_guard<std::mutex> lock {eventsMutex};
+        for (const auto& event : events) {
+            traceEvents.append(toJson(event, pid));
+        }
+    }
+
+    const QJsonObject trace {
+        {"traceEvents", traceEvents},
+        {"displayTimeUnit", "ms"}
+    };
+
+    // written again on every flush, a reader never sees a partial trace
+    QSaveFile file {filePath};
+    return file.open(QIODevice::WriteOnly) && file.write(QJsonDocument{trace}.toJson(QJsonDocument::Compact)) >= 0 && file.commit();
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <QString>
+
+/**
+ * Records how long the stages of a job take along with resident memory samples
+ * and writes them as Chrome trace events, viewable in chrome://tracing or Perfetto.
+ * While disabled a scope costs a single flag check. Only the most recent events are
+ * kept, so a long running process records in bounded memory.
+ */
+class Profiler
+{
+public:
+    /**
+     * Times the enclosing block as a stage. Memory is sampled when the outermost
+     * stage of a thread ends.
+     */
+    class Scope
+    {
+    public:
+        /**
+         * @param name - stage name, has to be a string literal
+         * @param index - view or band index shown with the stage, -1 for none
+         */
+        explicit Scope(const char* name, int index = -1);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        /**
+         * @brief end - ends the stage before the end of the block
+         */
+        void end();
+
+    private:
+        const char* m_name;
+        int m_index;
+        qint64 m_startNs = -1;
+    };
+
+    /**
+     * @brief setEnabled - starts or stops recording, disabled by default
+     */
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+
+    /**
+     * @brief sampleMemory - records current and peak resident memory of the process
+     */
+    static void sampleMemory();
+
+    /**
+     * @brief write - writes everything recorded so far as trace-event JSON
+     * @return true if the file was written
+     */
+    static bool write(const QString& filePath);
+};
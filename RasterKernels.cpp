@@ -0,0 +1,382 @@
+#include "RasterKernels.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define RASTER_KERNELS_AVX2_DISPATCH
+#include <immintrin.h>
+#endif
+
+namespace {
+
+using FillSpanFunction = void (*)(quint32* dst, int count, quint32 value);
+using CopyMatchingFunction = void (*)(uchar* dst, const uchar* src, const uchar* keys, int count, uchar key);
+
+void fillSpanScalar(quint32* dst, int count, quint32 value)
+{
+    std::fill_n(dst, count, value);
+}
+
+#if defined(__SSE2__)
+void fillSpanSse2(quint32* dst, int count, quint32 value)
+{
+    const __m128i pixels = _mm_set1_epi32(static_cast<int>(value));
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), pixels);
+    }
+    fillSpanScalar(dst + i, count - i, value);
+}
+#endif
+
+void copyMatchingScalar(uchar* dst, const uchar* src, const uchar* keys, int count, uchar key)
+{
+    for (int i = 0; i < count; ++i) {
+        if (keys[i] == key) {
+            dst[i] = src[i];
+        }
+    }
+}
+
+#if defined(__SSE2__)
+void copyMatchingSse2(uchar* dst, const uchar* src, const uchar* keys, int count, uchar key)
+{
+    const __m128i wanted = _mm_set1_epi8(static_cast<char>(key));
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m128i mask = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i)), wanted);
+        const __m128i kept = _mm_andnot_si128(mask, _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i)));
+        const __m128i taken = _mm_and_si128(mask, _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_or_si128(kept, taken));
+    }
+    copyMatchingScalar(dst + i, src + i, keys + i, count - i, key);
+}
+#endif
+
+#if defined(RASTER_KERNELS_AVX2_DISPATCH)
+__attribute__((target("avx2")))
+void copyMatchingAvx2(uchar* dst, const uchar* src, const uchar* keys, int count, uchar key)
+{
+    const __m256i wanted = _mm256_set1_epi8(static_cast<char>(key));
+    int i = 0;
+    for (; i + 32 <= count; i += 32) {
+        const __m256i mask = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)), wanted);
+        const __m256i pixels = _mm256_blendv_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i)),
+                                                  _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)), mask);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), pixels);
+    }
+    copyMatchingScalar(dst + i, src + i, keys + i, count - i, key);
+}
+
+__attribute__((target("avx2")))
+void fillSpanAvx2(quint32* dst, int count, quint32 value)
+{
+    const __m256i pixels = _mm256_set1_epi32(static_cast<int>(value));
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), pixels);
+    }
+    fillSpanScalar(dst + i, count - i, value);
+}
+#endif
+
+struct Dispatch
+{
+    FillSpanFunction fillSpan = fillSpanScalar;
+    CopyMatchingFunction copyMatching = copyMatchingScalar;
+    const char* name = "scalar";
+
+    Dispatch()
+    {
+#if defined(__SSE2__)
+        fillSpan = fillSpanSse2;
+        copyMatching = copyMatchingSse2;
+        name = "sse2";
+#endif
+#if defined(RASTER_KERNELS_AVX2_DISPATCH)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            fillSpan = fillSpanAvx2;
+            copyMatching = copyMatchingAvx2;
+            name = "avx2";
+        }
+#endif
+    }
+};
+
+const Dispatch& dispatch()
+{
+    static const Dispatch instance;
+    return instance;
+}
+
+// x * factor / 255 rounded the way the raster engine does it
+inline int multiply255(int x, int factor)
+{
+    const int value = x * factor + 128;
+    return (value + (value >> 8)) >> 8;
+}
+
+// part of the colour a gradient from transparent to black covers at position 't'
+inline int gradientAlpha(float t)
+{
+    return static_cast<int>(qBound(0.0f, t, 1.0f) * 255 + 0.5f);
+}
+
+inline quint32 shadePixel(float t, int red, int green, int blue)
+{
+    const int keep = 255 - gradientAlpha(t);
+    return qRgb(multiply255(red, keep), multiply255(green, keep), multiply255(blue, keep));
+}
+
+/**
+ * Gradient position grows linearly along a scanline: t(i) = t0 + i * dt.
+ */
+void shadeSpan(quint32* dst, int count, float t0, float dt, QRgb color)
+{
+    const int red = qRed(color);
+    const int green = qGreen(color);
+    const int blue = qBlue(color);
+    int i = 0;
+
+#if defined(__SSE2__)
+    const __m128 step = _mm_set1_ps(dt * 4);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(255.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128i max = _mm_set1_epi32(255);
+    const __m128i bias = _mm_set1_epi32(128);
+    const __m128i redChannel = _mm_set1_epi32(red);
+    const __m128i greenChannel = _mm_set1_epi32(green);
+    const __m128i blueChannel = _mm_set1_epi32(blue);
+    const __m128i opaque = _mm_set1_epi32(static_cast<int>(0xff000000));
+    __m128 t = _mm_add_ps(_mm_set1_ps(t0), _mm_mul_ps(_mm_set_ps(3, 2, 1, 0), _mm_set1_ps(dt)));
+
+    // channel * keep < 2^16, so 16-bit multiplication of 32-bit lanes is exact
+    const auto multiply = [&](__m128i channel, __m128i keep) {
+        const __m128i value = _mm_add_epi32(_mm_mullo_epi16(channel, keep), bias);
+        return _mm_srli_epi32(_mm_add_epi32(value, _mm_srli_epi32(value, 8)), 8);
+    };
+
+    for (; i + 4 <= count; i += 4) {
+        const __m128 clamped = _mm_min_ps(_mm_max_ps(t, zero), one);
+        const __m128i alpha = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(clamped, scale), half));
+        const __m128i keep = _mm_sub_epi32(max, alpha);
+
+        __m128i pixels = _mm_or_si128(opaque, _mm_slli_epi32(multiply(redChannel, keep), 16));
+        pixels = _mm_or_si128(pixels, _mm_slli_epi32(multiply(greenChannel, keep), 8));
+        pixels = _mm_or_si128(pixels, multiply(blueChannel, keep));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), pixels);
+
+        t = _mm_add_ps(t, step);
+    }
+#endif
+
+    for (; i < count; ++i) {
+        dst[i] = shadePixel(t0 + i * dt, red, green, blue);
+    }
+}
+
+/**
+ * Adds 'count' bytes of a source row to 16-bit column sums.
+ */
+void accumulateRow(quint16* sums, const uchar* src, int count)
+{
+    int i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        auto* sum = reinterpret_cast<__m128i*>(sums + i);
+        _mm_storeu_si128(sum, _mm_add_epi16(_mm_loadu_si128(sum), _mm_unpacklo_epi8(bytes, zero)));
+        _mm_storeu_si128(sum + 1, _mm_add_epi16(_mm_loadu_si128(sum + 1), _mm_unpackhi_epi8(bytes, zero)));
+    }
+#endif
+
+    for (; i < count; ++i) {
+        sums[i] = static_cast<quint16>(sums[i] + src[i]);
+    }
+}
+
+inline uchar intensity(QRgb color)
+{
+    return static_cast<uchar>(qMax(qRed(color), qMax(qGreen(color), qBlue(color))));
+}
+
+} // namespace
+
+namespace RasterKernels {
+
+bool supportsFormat(QImage::Format format)
+{
+    return withPixels(format, [](auto) {});
+}
+
+bool supportsDownsampling(QImage::Format format)
+{
+    return supportsFormat(format) || format == QImage::Format_BGR888;
+}
+
+QVector<QRgb> rampColorTable(QRgb color)
+{
+    QVector<QRgb> table(256);
+    for (int i = 0; i < table.size(); ++i) {
+        table[i] = qRgb(multiply255(qRed(color), i), multiply255(qGreen(color), i), multiply255(qBlue(color), i));
+    }
+    return table;
+}
+
+const char* instructionSet()
+{
+    return dispatch().name;
+}
+
+QRect toFillRect(const QRectF& rect)
+{
+    int x1 = qRound(rect.left());
+    int y1 = qRound(rect.top());
+    int x2 = qRound(rect.right());
+    int y2 = qRound(rect.bottom());
+
+    if (x2 < x1) {
+        std::swap(x1, x2);
+    }
+    if (y2 < y1) {
+        std::swap(y1, y2);
+    }
+    return QRect{x1, y1, x2 - x1, y2 - y1};
+}
+
+void fillSpan(quint32* dst, int count, quint32 value)
+{
+    dispatch().fillSpan(dst, count, value);
+}
+
+void copyMatching(uchar* dst, const uchar* src, const uchar* keys, int count, uchar key)
+{
+    dispatch().copyMatching(dst, src, keys, count, key);
+}
+
+void boxDownsampleRow(uchar* dst, const uchar* src, int bytesPerLine, int width, int bytesPerPixel, int factor)
+{
+    const int count = width * factor * bytesPerPixel;
+    thread_local std::vector<quint16> sums;
+    sums.assign(static_cast<size_t>(count), 0);
+
+    // columns are summed with SIMD first, every output byte then adds 'factor' column sums
+    for (int k = 0; k < factor; ++k) {
+        accumulateRow(sums.data(), src + static_cast<qint64>(k) * bytesPerLine, count);
+    }
+
+    // exact (sum + area / 2) / area for sums below 2^24 and area above 1 by a multiplication
+    const quint64 area = static_cast<quint64>(factor) * factor;
+    const quint64 half = area / 2;
+    const quint64 magic = ((quint64{1} << 40) + area - 1) / area;
+    const int stride = factor * bytesPerPixel;
+    for (int x = 0; x < width; ++x) {
+        const quint16* block = sums.data() + x * stride;
+        for (int c = 0; c < bytesPerPixel; ++c) {
+            quint64 sum = 0;
+            for (int j = c; j < stride; j += bytesPerPixel) {
+                sum += block[j];
+            }
+            dst[x * bytesPerPixel + c] = static_cast<uchar>(((sum + half) * magic) >> 40);
+        }
+    }
+}
+
+void Argb32Pixels::fill(uchar* dst, int count, QRgb color)
+{
+    dispatch().fillSpan(reinterpret_cast<quint32*>(dst), count, color | 0xff000000);
+}
+
+void Argb32Pixels::shade(uchar* dst, int count, float t0, float dt, QRgb color)
+{
+    shadeSpan(reinterpret_cast<quint32*>(dst), count, t0, dt, color);
+}
+
+void Rgb888Pixels::fill(uchar* dst, int count, QRgb color)
+{
+    if (count <= 0) {
+        return;
+    }
+
+    dst[0] = static_cast<uchar>(qRed(color));
+    dst[1] = static_cast<uchar>(qGreen(color));
+    dst[2] = static_cast<uchar>(qBlue(color));
+
+    // pixels are not word sized, the filled part doubles with every copy instead
+    int filled = 1;
+    while (filled < count) {
+        const int copied = std::min(filled, count - filled);
+        std::memcpy(dst + filled * BYTES_PER_PIXEL, dst, static_cast<size_t>(copied) * BYTES_PER_PIXEL);
+        filled += copied;
+    }
+}
+
+void Rgb888Pixels::shade(uchar* dst, int count, float t0, float dt, QRgb color)
+{
+    const int red = qRed(color);
+    const int green = qGreen(color);
+    const int blue = qBlue(color);
+    for (int i = 0; i < count; ++i, dst += BYTES_PER_PIXEL) {
+        const int keep = 255 - gradientAlpha(t0 + i * dt);
+        dst[0] = static_cast<uchar>(multiply255(red, keep));
+        dst[1] = static_cast<uchar>(multiply255(green, keep));
+        dst[2] = static_cast<uchar>(multiply255(blue, keep));
+    }
+}
+
+void Gray8Pixels::fill(uchar* dst, int count, QRgb color)
+{
+    std::memset(dst, qGray(color), static_cast<size_t>(count));
+}
+
+void Gray8Pixels::shade(uchar* dst, int count, float t0, float dt, QRgb color)
+{
+    // channels are shaded first, as in the RGB formats Qt converts from
+    const int red = qRed(color);
+    const int green = qGreen(color);
+    const int blue = qBlue(color);
+    for (int i = 0; i < count; ++i) {
+        const int keep = 255 - gradientAlpha(t0 + i * dt);
+        dst[i] = static_cast<uchar>(qGray(multiply255(red, keep), multiply255(green, keep), multiply255(blue, keep)));
+    }
+}
+
+void RampPixels::fill(uchar* dst, int count, QRgb color)
+{
+    std::memset(dst, intensity(color), static_cast<size_t>(count));
+}
+
+void RampPixels::shade(uchar* dst, int count, float t0, float dt, QRgb color)
+{
+    const int value = intensity(color);
+    for (int i = 0; i < count; ++i) {
+        dst[i] = static_cast<uchar>(multiply255(value, 255 - gradientAlpha(t0 + i * dt)));
+    }
+}
+
+void fillRect(QImage& image, const QRect& rect, QRgb color)
+{
+    withPixels(image.format(), [&](auto pixels) {
+        fillRect<decltype(pixels)>(image, rect, color);
+    });
+}
+
+void fillShadedRect(QImage& image, const QRect& rect, const QRectF& gradientRect, QRgb color)
+{
+    withPixels(image.format(), [&](auto pixels) {
+        fillShadedRect<decltype(pixels)>(image, rect, gradientRect, color);
+    });
+}
+
+} // namespace RasterKernels
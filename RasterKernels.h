@@ -0,0 +1,198 @@
+#pragma once
+
+#include <QImage>
+#include <QRect>
+
+/**
+ * Scanline writers for patterns made of opaque rectangles. They write 32-bit, RGB888
+ * and 8-bit pixels directly, 32-bit spans are vectorized with SSE2, or AVX2 when
+ * the CPU has it.
+ *
+ * Grayscale8 images hold qGray of the colour, the grey Qt converts it to. Indexed8
+ * images hold the largest channel of the colour as an index into rampColorTable()
+ * of the colour its pixels are shades of, which they are expected to carry.
+ */
+namespace RasterKernels {
+
+/**
+ * Largest difference of a colour channel between fillShadedRect and QPainter
+ * drawing a QLinearGradient from transparent to black over the same rectangle.
+ */
+const int SHADE_TOLERANCE = 2;
+
+/**
+ * @brief supportsFormat - checks whether kernels can write pixels of 'format'
+ */
+bool supportsFormat(QImage::Format format);
+
+/**
+ * Largest factor boxDownsampleRow() handles.
+ */
+const int MAX_DOWNSAMPLE_FACTOR = 256;
+
+/**
+ * @brief supportsDownsampling - checks whether boxDownsampleRow() averages pixels of 'format'
+ *                               correctly: opaque ones of 8-bit channels, intensities included,
+ *                               since the indices of a ramp palette are proportional to colours
+ */
+bool supportsDownsampling(QImage::Format format);
+
+/**
+ * @brief rampColorTable - 256 shades of 'color' from black, entry i is 'color' * i / 255
+ */
+QVector<QRgb> rampColorTable(QRgb color);
+
+/**
+ * @brief instructionSet - name of the instruction set selected for this CPU
+ */
+const char* instructionSet();
+
+/**
+ * @brief toFillRect - pixels covered by an aliased QPainter fill of device 'rect'
+ */
+QRect toFillRect(const QRectF& rect);
+
+/**
+ * @brief fillSpan - sets 'count' pixels starting at 'dst' to 'value'
+ */
+void fillSpan(quint32* dst, int count, quint32 value);
+
+/**
+ * @brief copyMatching - copies those of 'count' bytes of 'src' into 'dst' whose byte
+ *                       of 'keys' equals 'key', other bytes of 'dst' are kept
+ */
+void copyMatching(uchar* dst, const uchar* src, const uchar* keys, int count, uchar key);
+
+/**
+ * @brief boxDownsampleRow - writes 'width' pixels of 'bytesPerPixel' bytes into 'dst', every byte
+ *                           the rounded mean of the same byte over a 'factor' x 'factor' block
+ *                           of the rows starting at 'src', 'bytesPerLine' bytes apart
+ * @param factor - 2 to MAX_DOWNSAMPLE_FACTOR
+ */
+void boxDownsampleRow(uchar* dst, const uchar* src, int bytesPerLine, int width, int bytesPerPixel, int factor);
+
+/**
+ * Span writers of the pixel formats kernels support. Rect kernels are instantiated
+ * per writer, so the format is resolved once per image rather than for every span.
+ * 'dst' is the first byte of a span of 'count' pixels; a shaded span has the gradient
+ * position t0 + i * dt at pixel i.
+ */
+struct Argb32Pixels // ARGB32, RGB32 and ARGB32_Premultiplied store opaque pixels the same way
+{
+    static const int BYTES_PER_PIXEL = 4;
+    static void fill(uchar* dst, int count, QRgb color);
+    static void shade(uchar* dst, int count, float t0, float dt, QRgb color);
+};
+
+struct Rgb888Pixels
+{
+    static const int BYTES_PER_PIXEL = 3;
+    static void fill(uchar* dst, int count, QRgb color);
+    static void shade(uchar* dst, int count, float t0, float dt, QRgb color);
+};
+
+struct Gray8Pixels // Grayscale8, qGray of the colour as Qt converts it
+{
+    static const int BYTES_PER_PIXEL = 1;
+    static void fill(uchar* dst, int count, QRgb color);
+    static void shade(uchar* dst, int count, float t0, float dt, QRgb color);
+};
+
+struct RampPixels // Indexed8 of a ramp palette, the index is the strongest channel
+{
+    static const int BYTES_PER_PIXEL = 1;
+    static void fill(uchar* dst, int count, QRgb color);
+    static void shade(uchar* dst, int count, float t0, float dt, QRgb color);
+};
+
+/**
+ * @brief withPixels - calls 'function' with the span writer of 'format'
+ * @return false if kernels can not write pixels of 'format'
+ */
+template <typename Function>
+bool withPixels(QImage::Format format, Function&& function)
+{
+    switch (format) {
+        case QImage::Format_ARGB32:
+        case QImage::Format_RGB32:
+        case QImage::Format_ARGB32_Premultiplied:
+            function(Argb32Pixels{});
+            return true;
+
+        case QImage::Format_RGB888:
+            function(Rgb888Pixels{});
+            return true;
+
+        case QImage::Format_Grayscale8:
+            function(Gray8Pixels{});
+            return true;
+
+        case QImage::Format_Indexed8:
+            function(RampPixels{});
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief fillRect - fills 'rect' clipped by image bounds with opaque 'color',
+ *                   'image' is of a format written by 'Pixels'
+ */
+template <typename Pixels>
+void fillRect(QImage& image, const QRect& rect, QRgb color)
+{
+    const QRect area = rect & image.rect();
+    if (area.isEmpty()) {
+        return;
+    }
+
+    const int offset = area.left() * Pixels::BYTES_PER_PIXEL;
+    for (int y = area.top(); y <= area.bottom(); ++y) {
+        Pixels::fill(image.scanLine(y) + offset, area.width(), color);
+    }
+}
+
+/**
+ * @brief fillShadedRect - fills 'rect' clipped by image bounds with opaque 'color'
+ *                         fading to black along the diagonal of 'gradientRect',
+ *                         from its top-left to its bottom-right corner;
+ *                         'image' is of a format written by 'Pixels'
+ */
+template <typename Pixels>
+void fillShadedRect(QImage& image, const QRect& rect, const QRectF& gradientRect, QRgb color)
+{
+    const QRect area = rect & image.rect();
+    if (area.isEmpty()) {
+        return;
+    }
+
+    const qreal dx = gradientRect.width();
+    const qreal dy = gradientRect.height();
+    const qreal lengthSquared = dx * dx + dy * dy;
+    if (lengthSquared <= 0) {
+        fillRect<Pixels>(image, area, color);
+        return;
+    }
+
+    // gradient is sampled at pixel centres, as the raster engine does
+    const float dt = static_cast<float>(dx / lengthSquared);
+    const int offset = area.left() * Pixels::BYTES_PER_PIXEL;
+    for (int y = area.top(); y <= area.bottom(); ++y) {
+        const qreal t0 = ((area.left() + 0.5 - gradientRect.x()) * dx + (y + 0.5 - gradientRect.y()) * dy) / lengthSquared;
+        Pixels::shade(image.scanLine(y) + offset, area.width(), static_cast<float>(t0), dt, color);
+    }
+}
+
+/**
+ * @brief fillRect - fillRect<>() with the writer of the image format
+ */
+void fillRect(QImage& image, const QRect& rect, QRgb color);
+
+/**
+ * @brief fillShadedRect - fillShadedRect<>() with the writer of the image format
+ */
+void fillShadedRect(QImage& image, const QRect& rect, const QRectF& gradientRect, QRgb color);
+
+} // namespace RasterKernels
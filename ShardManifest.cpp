@@ -0,0 +1,256 @@
+#include "ShardManifest.h"
+#include "Profiler.h"
+
+#include <map>
+#include <utility>
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+namespace {
+
+const int MANIFEST_VERSION = 1;
+
+bool hashFile(const QString& filePath, qint64& size, QByteArray& sha256)
+{
+    QFile file {filePath};
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QCryptographicHash hash {QCryptographicHash::Sha256};
+    if (!hash.addData(&file)) {
+        return false;
+    }
+    size = file.size();
+    sha256 = hash.result().toHex();
+    return true;
+}
+
+bool loadManifest(const QString& filePath, QJsonObject& manifest, QString& error)
+{
+    QFile file {filePath};
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        return false;
+    }
+
+    QJsonParseError parseError;
+    const QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &parseError);
+    if (!document.isObject()) {
+        error = document.isNull() ? parseError.errorString() : "object is expected";
+        return false;
+    }
+
+    manifest = document.object();
+    if (manifest.value("version").toInt() != MANIFEST_VERSION) {
+        error = "unsupported version";
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+ShardManifest::ShardManifest(const Shard& shard, const QString& generator)
+    : m_shard(shard)
+    , m_generator(generator)
+{}
+
+bool ShardManifest::parseShard(const QString& text, Shard& shard)
+{
+    const QStringList values = text.split('/');
+    if (values.size() != 2) {
+        return false;
+    }
+
+    bool ok = true;
+    Shard parsed;
+    parsed.index = values.at(0).trimmed().toInt(&ok);
+    if (!ok) {
+        return false;
+    }
+
+    parsed.count = values.at(1).trimmed().toInt(&ok);
+    if (!ok || parsed.count <= 0 || parsed.index < 0 || parsed.index >= parsed.count) {
+        return false;
+    }
+
+    shard = parsed;
+    return true;
+}
+
+QString ShardManifest::defaultPath(const QString& basePath, const Shard& shard)
+{
+    return QString{"%1.shard-%2-of-%3.json"}.arg(basePath).arg(shard.index).arg(shard.count);
+}
+
+void ShardManifest::addJob(const BatchManifest::Job& job, int outputs)
+{
+    m_jobs.push_back(Job{job, outputs});
+}
+
+bool ShardManifest::addFile(int job, int output, const QString& filePath)
+{
+    Profiler::Scope scope {"hash", output};
+    File file;
+    file.job = job;
+    file.output = output;
+    file.path = QFileInfo{filePath}.absoluteFilePath();
+    if (!hashFile(filePath, file.size, file.sha256)) {
+        return false;
+    }
+
+    m_files.push_back(file);
+    return true;
+}
+
+bool ShardManifest::save(const QString& filePath, QString& error) const
+{
+    const QDir directory = QFileInfo{filePath}.absoluteDir();
+
+    QJsonArray jobs;
+    for (const auto& job : m_jobs) {
+        QJsonObject object = BatchManifest::toJson(job.job);
+        object.insert("outputs", job.outputs);
+        jobs.append(object);
+    }
+
+    QJsonArray files;
+    for (const auto& file : m_files) {
+        files.append(QJsonObject{
+            {"job", file.job},
+            {"output", file.output},
+            {"path", directory.relativeFilePath(file.path)},
+            {"size", file.size},
+            {"sha256", QString::fromLatin1(file.sha256)}
+        });
+    }
+
+    const QJsonObject manifest {
+        {"version", MANIFEST_VERSION},
+        {"shard", m_shard.index},
+        {"shards", m_shard.count},
+        {"generator", m_generator},
+        {"jobs", jobs},
+        {"files", files}
+    };
+
+    QSaveFile file {filePath};
+    if (!file.open(QIODevice::WriteOnly) || file.write(QJsonDocument{manifest}.toJson()) < 0 || !file.commit()) {
+        error = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool ShardManifest::verify(const QStringList& manifestPaths, QStringList& problems, int& verifiedFiles)
+{
+    verifiedFiles = 0;
+    if (manifestPaths.isEmpty()) {
+        problems << "no shard manifests given";
+        return false;
+    }
+
+    // the first manifest defines the run, the others have to agree with it
+    QJsonObject run;
+    std::vector<qint64> firstUnits; // of every job and one past the last unit of the run
+    std::map<int, QString> shards;
+    std::map<std::pair<int, int>, QString> listed;
+    for (const QString& manifestPath : manifestPaths) {
+        QJsonObject manifest;
+        QString error;
+        if (!loadManifest(manifestPath, manifest, error)) {
+            problems << QString{"%1: %2"}.arg(manifestPath, error);
+            continue;
+        }
+
+        if (run.isEmpty()) {
+            run = manifest;
+            firstUnits.push_back(0);
+            for (const auto& job : run.value("jobs").toArray()) {
+                firstUnits.push_back(firstUnits.back() + qMax(0, job.toObject().value("outputs").toInt()));
+            }
+        } else if (manifest.value("shards") != run.value("shards") || manifest.value("generator") != run.value("generator") ||
+                   manifest.value("jobs") != run.value("jobs")) {
+            problems << QString{"%1: belongs to another run, its shard count, generator or jobs differ"}.arg(manifestPath);
+            continue;
+        }
+
+        const Shard shard {manifest.value("shard").toInt(-1), run.value("shards").toInt()};
+        if (shard.count < 1 || shard.index < 0 || shard.index >= shard.count) {
+            problems << QString{"%1: shard %2 is not one of the %3 shards of the run"}.arg(manifestPath).arg(shard.index).arg(shard.count);
+            continue;
+        }
+
+        if (!shards.emplace(shard.index, manifestPath).second) {
+            problems << QString{"%1: shard %2 is already given by %3"}.arg(manifestPath).arg(shard.index).arg(shards[shard.index]);
+            continue;
+        }
+
+        const QDir directory = QFileInfo{manifestPath}.absoluteDir();
+        for (const auto& value : manifest.value("files").toArray()) {
+            const QJsonObject entry = value.toObject();
+            const auto output = std::make_pair(entry.value("job").toInt(-1), entry.value("output").toInt(-1));
+            const QString filePath = directory.absoluteFilePath(entry.value("path").toString());
+            const int jobCount = static_cast<int>(firstUnits.size()) - 1;
+            if (output.first < 0 || output.first >= jobCount || output.second < 0 ||
+                output.second >= firstUnits[output.first + 1] - firstUnits[output.first]) {
+                problems << QString{"%1: job %2 output %3 is not an output of the run"}
+                            .arg(manifestPath).arg(output.first).arg(output.second);
+                continue;
+            }
+
+            if (!shard.owns(firstUnits[output.first] + output.second)) {
+                problems << QString{"%1: job %2 output %3 belongs to another shard than %4"}
+                            .arg(manifestPath).arg(output.first).arg(output.second).arg(shard.index);
+                continue;
+            }
+
+            if (!listed.emplace(output, manifestPath).second) {
+                problems << QString{"%1: job %2 output %3 is already listed by %4"}
+                            .arg(manifestPath).arg(output.first).arg(output.second).arg(listed[output]);
+                continue;
+            }
+
+            qint64 size = 0;
+            QByteArray sha256;
+            if (!hashFile(filePath, size, sha256)) {
+                problems << QString{"%1: can not be read"}.arg(filePath);
+            } else if (size != static_cast<qint64>(entry.value("size").toDouble()) || sha256 != entry.value("sha256").toString().toLatin1()) {
+                problems << QString{"%1: differs from the file shard %2 wrote"}.arg(filePath).arg(shard.index);
+            } else {
+                ++verifiedFiles;
+            }
+        }
+    }
+
+    if (run.isEmpty()) {
+        return false;
+    }
+
+    const int count = run.value("shards").toInt();
+    for (int shard = 0; shard < count; ++shard) {
+        if (shards.find(shard) == shards.end()) {
+            problems << QString{"manifest of shard %1 of %2 is missing"}.arg(shard).arg(count);
+        }
+    }
+
+    const QJsonArray jobs = run.value("jobs").toArray();
+    for (int job = 0; job < jobs.size(); ++job) {
+        const int outputs = jobs.at(job).toObject().value("outputs").toInt();
+        for (int output = 0; output < outputs; ++output) {
+            if (listed.find(std::make_pair(job, output)) == listed.end()) {
+                problems << QString{"job %1 (%2) output %3 is not listed by any shard"}
+                            .arg(job).arg(jobs.at(job).toObject().value("destination").toString()).arg(output);
+            }
+        }
+    }
+    return problems.isEmpty();
+}
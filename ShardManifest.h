@@ -0,0 +1,97 @@
+#pragma once
+
+#include <vector>
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+
+#include "BatchManifest.h"
+
+/**
+ * Record of the files written by one shard of a run split over several processes
+ * or machines. Every output file of the run - a view of a multi-view job or the
+ * image of any other job - is a unit, numbered in job order, and shard i of N
+ * renders the units u with u % N == i. Files are named exactly as by an unsharded run.
+ *
+ * Each shard saves its manifest as JSON: the whole job list, so any shard tells what
+ * the run produces, and the path, size and SHA-256 of every file it wrote. Paths are
+ * relative to the manifest. verify() checks that the manifests of all shards
+ * together account for every unit and that the files on disk still match them.
+ */
+class ShardManifest
+{
+public:
+    struct Shard
+    {
+        int index = 0;
+        int count = 1;
+
+        bool isSharded() const { return count > 1; }
+        bool owns(qint64 unit) const { return unit % count == index; }
+    };
+
+    /**
+     * @param generator - identifies the pixels and the encoding, shards of one run
+     *                    have to agree on it
+     */
+    ShardManifest(const Shard& shard, const QString& generator);
+
+    /**
+     * @brief parseShard - reads "i/N", 0 <= i < N
+     */
+    static bool parseShard(const QString& text, Shard& shard);
+
+    /**
+     * @brief defaultPath - manifest path of 'shard' next to 'basePath', the destination
+     *                      or the batch manifest of the run
+     */
+    static QString defaultPath(const QString& basePath, const Shard& shard);
+
+    /**
+     * @brief addJob - appends a job of the run producing 'outputs' files
+     */
+    void addJob(const BatchManifest::Job& job, int outputs);
+
+    /**
+     * @brief addFile - hashes the file written as output 'output' of job 'job'
+     * @return false if the file can not be read
+     */
+    bool addFile(int job, int output, const QString& filePath);
+
+    /**
+     * @brief save - writes the manifest into 'filePath', the file is replaced only once complete
+     */
+    bool save(const QString& filePath, QString& error) const;
+
+    /**
+     * @brief verify - checks that 'manifestPaths' are the manifests of all shards of one
+     *                 run, that every output is listed once, by the shard owning it,
+     *                 that nothing but outputs of the run is listed and that files match
+     * @param problems - receives a description of every problem found
+     * @param verifiedFiles - receives the number of files whose size and hash match
+     * @return true if the run is complete and intact
+     */
+    static bool verify(const QStringList& manifestPaths, QStringList& problems, int& verifiedFiles);
+
+private:
+    struct Job
+    {
+        BatchManifest::Job job;
+        int outputs = 1;
+    };
+
+    struct File
+    {
+        int job = 0;
+        int output = 0;
+        QString path; // absolute
+        qint64 size = 0;
+        QByteArray sha256;
+    };
+
+    Shard m_shard;
+    QString m_generator;
+    std::vector<Job> m_jobs;
+    std::vector<File> m_files;
+};
@@ -0,0 +1,192 @@
+#include "StampCache.h"
+
+#include <atomic>
+#include <cmath>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include <QHash>
+#include <QPainter>
+
+namespace {
+
+// pens and rounding may touch pixels next to primitive bounds
+const int STAMP_MARGIN = 2;
+const int MAX_STAMPS = 4096;
+const qint64 MAX_STAMP_BYTES = 1 << 20;
+// the cache lives as long as the process, a daemon included
+const qint64 MAX_CACHE_BYTES = 64 << 20;
+
+/**
+ * Stamp identity, compared exactly: hashes only pick the bucket, a collision never
+ * gives the stamp of another primitive.
+ */
+struct StampKey
+{
+    StampCache::Kind kind;
+    qreal x;
+    qreal y;
+    qreal width;
+    qreal height;
+    qreal right; // of the bounds
+    qreal bottom;
+    StampCache::Parameter parameter;
+
+    bool operator==(const StampKey& other) const
+    {
+        return kind == other.kind && x == other.x && y == other.y && width == other.width && height == other.height &&
+               right == other.right && bottom == other.bottom && parameter == other.parameter;
+    }
+};
+
+struct StampKeyHash
+{
+    size_t operator()(const StampKey& key) const
+    {
+        uint seed = qHash(static_cast<int>(key.kind));
+        for (const qreal value : {key.x, key.y, key.width, key.height, key.right, key.bottom,
+                                  key.parameter.penWidth, key.parameter.cellHeight}) {
+            seed = qHash(value, seed);
+        }
+        for (const uint value : {key.parameter.fill, key.parameter.pen,
+                                 static_cast<uint>(key.parameter.rows), static_cast<uint>(key.parameter.columns)}) {
+            seed = qHash(value, seed);
+        }
+        return seed;
+    }
+};
+
+struct Stamp
+{
+    QImage image;
+    std::list<StampKey>::iterator use; // position in recentStamps
+};
+
+std::atomic<bool> enabled {true};
+std::atomic<qint64> hits {0};
+std::atomic<qint64> misses {0};
+std::atomic<qint64> uncached {0};
+std::mutex stampsMutex;
+std::unordered_map<StampKey, Stamp, StampKeyHash> stamps;
+std::list<StampKey> recentStamps; // most recently used first
+qint64 stampBytes = 0;
+
+/**
+ * Drops least recently used stamps until 'bytes' more fit into the budget, stampsMutex is held.
+ */
+void makeRoom(qint64 bytes)
+{
+    while (!recentStamps.empty() && stampBytes + bytes > MAX_CACHE_BYTES) {
+        const auto it = stamps.find(recentStamps.back());
+        stampBytes -= it->second.image.sizeInBytes();
+        stamps.erase(it);
+        recentStamps.pop_back();
+    }
+}
+
+} // namespace
+
+void StampCache::draw(QPainter& painter, Kind kind, const QRectF& rect, const QRectF& bounds,
+                      const Parameter& parameter, const PaintFunction& paint)
+{
+    if (!enabled) {
+        paint(painter, rect);
+        return;
+    }
+
+    // stamp starts at a whole pixel, so the primitive keeps its sub-pixel phase
+    const QPoint origin {static_cast<int>(std::floor(bounds.left())) - STAMP_MARGIN,
+                         static_cast<int>(std::floor(bounds.top())) - STAMP_MARGIN};
+    const QRectF local = rect.translated(-origin);
+    const QRectF localBounds = bounds.translated(-origin);
+    const StampKey key {kind, local.x(), local.y(), local.width(), local.height(),
+                        localBounds.right(), localBounds.bottom(), parameter};
+
+    QImage stamp;
+    bool full = false;
+    {
+        std::lock_guard<std::mutex> lock {stampsMutex};
+        const auto it = stamps.find(key);
+        if (it != stamps.end()) {
+            stamp = it->second.image;
+            recentStamps.splice(recentStamps.begin(), recentStamps, it->second.use);
+        } else {
+            full = static_cast<int>(stamps.size()) >= MAX_STAMPS;
+        }
+    }
+
+    if (!stamp.isNull()) {
+        hits++;
+        painter.drawImage(origin, stamp);
+        return;
+    }
+
+    // a stamp which would not be kept costs more than painting the primitive once
+    const QSize size {static_cast<int>(std::ceil(localBounds.right())) + STAMP_MARGIN,
+                      static_cast<int>(std::ceil(localBounds.bottom())) + STAMP_MARGIN};
+    if (full || size.width() <= 0 || size.height() <= 0 ||
+        static_cast<qint64>(size.width()) * size.height() * 4 > MAX_STAMP_BYTES) {
+        uncached++;
+        paint(painter, rect);
+        return;
+    }
+
+    stamp = QImage{size, QImage::Format_ARGB32_Premultiplied};
+    stamp.fill(Qt::transparent);
+    {
+        QPainter stampPainter {&stamp};
+        paint(stampPainter, local);
+    }
+
+    {
+        // the map may have filled up or got the stamp from another thread meanwhile
+        std::lock_guard<std::mutex> lock {stampsMutex};
+        if (stamps.find(key) != stamps.end()) {
+            hits++;
+        } else if (static_cast<int>(stamps.size()) >= MAX_STAMPS) {
+            uncached++;
+        } else {
+            makeRoom(stamp.sizeInBytes());
+            recentStamps.push_front(key);
+            stamps.emplace(key, Stamp{stamp, recentStamps.begin()});
+            stampBytes += stamp.sizeInBytes();
+            misses++;
+        }
+    }
+    painter.drawImage(origin, stamp);
+}
+
+void StampCache::setEnabled(bool value)
+{
+    enabled = value;
+}
+
+bool StampCache::isEnabled()
+{
+    return enabled;
+}
+
+StampCache::Stats StampCache::stats()
+{
+    Stats result;
+    result.hits = hits;
+    result.misses = misses;
+    result.uncached = uncached;
+
+    std::lock_guard<std::mutex> lock {stampsMutex};
+    result.stamps = static_cast<int>(stamps.size());
+    result.bytes = stampBytes;
+    return result;
+}
+
+void StampCache::clear()
+{
+    std::lock_guard<std::mutex> lock {stampsMutex};
+    stamps.clear();
+    recentStamps.clear();
+    stampBytes = 0;
+    hits = 0;
+    misses = 0;
+    uncached = 0;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <functional>
+
+#include <QImage>
+#include <QRectF>
+
+class QPainter;
+
+/**
+ * Primitives repeated all over a pattern are rendered once into a stamp and
+ * then composited with a blit. Stamps are keyed by the primitive kind, size,
+ * parameter and the sub-pixel phase of its position, so a blit gives the same
+ * pixels as painting the primitive directly. Stamps share a fixed memory budget,
+ * the least recently used ones are dropped to make room for new ones.
+ */
+class StampCache
+{
+public:
+    enum Kind
+    {
+        SHADED_RECT,
+        LATTICE,
+        RECT
+    };
+
+    struct Stats
+    {
+        qint64 hits = 0;
+        qint64 misses = 0;
+        qint64 uncached = 0; // painted directly because the cache was full or stamp too big
+        int stamps = 0;
+        qint64 bytes = 0;
+    };
+
+    /**
+     * Everything besides rect size changing the pixels of a primitive, stamps are
+     * shared by primitives with exactly equal parameters only.
+     */
+    struct Parameter
+    {
+        QRgb fill = 0;
+        QRgb pen = 0;
+        qreal penWidth = 0;
+        qint32 rows = 0;
+        qint32 columns = 0;
+        qreal cellHeight = 0;
+
+        bool operator==(const Parameter& other) const
+        {
+            return fill == other.fill && pen == other.pen && penWidth == other.penWidth &&
+                   rows == other.rows && columns == other.columns && cellHeight == other.cellHeight;
+        }
+    };
+
+    using PaintFunction = std::function<void(QPainter& painter, const QRectF& rect)>;
+
+    /**
+     * @brief draw - composites primitive placed at 'rect' onto 'painter'
+     * @param kind - primitive kind
+     * @param rect - primitive position, defines the stamp phase
+     * @param bounds - area the primitive paints, in the same coordinates as 'rect'
+     * @param parameter - anything besides rect size that changes the primitive pixels
+     * @param paint - paints primitive at given rect, used to render the stamp
+     */
+    static void draw(QPainter& painter, Kind kind, const QRectF& rect, const QRectF& bounds,
+                     const Parameter& parameter, const PaintFunction& paint);
+
+    /**
+     * @brief setEnabled - when disabled primitives are painted directly
+     * @param enabled - true by default
+     */
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+
+    static Stats stats();
+
+    /**
+     * @brief clear - drops all stamps and resets statistics
+     */
+    static void clear();
+};
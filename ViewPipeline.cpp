@@ -0,0 +1,187 @@
+#include "ViewPipeline.h"
+#include "BoundedQueue.h"
+#include "Profiler.h"
+#include "WorkerPool.h"
+
+#include <thread>
+#include <vector>
+
+#include <QBuffer>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QThread>
+
+namespace {
+
+struct RenderedView
+{
+    int index = -1;
+    QString fileName;
+    QImage image;
+};
+
+struct EncodedView
+{
+    int index = -1;
+    QString fileName;
+    QByteArray data;
+};
+
+bool encode(const RenderedView& view, QByteArray& data)
+{
+    Profiler::Scope scope {"encode", view.index};
+    QBuffer buffer {&data};
+    buffer.open(QIODevice::WriteOnly);
+
+    return ImageEncoder::encode(view.image, CalibrationFactory::encoder(), QFileInfo{view.fileName}.suffix(), &buffer);
+}
+
+bool write(const EncodedView& view)
+{
+    Profiler::Scope scope {"write", view.index};
+    QSaveFile file {view.fileName};
+    return file.open(QIODevice::WriteOnly) && file.write(view.data) == view.data.size() && file.commit();
+}
+
+QString formatStage(const QString& name, const ViewPipeline::StageStats& stats, qint64 wallNs)
+{
+    const double busySec = stats.busyNs / 1e9;
+    const double mb = stats.bytes / (1024.0 * 1024.0);
+    return QString{"%1: %2 views, %3 MB, busy %4 s, blocked %5 s, %6 MB/s busy, %7 MB/s wall"}
+            .arg(name)
+            .arg(stats.items.load())
+            .arg(mb, 0, 'f', 1)
+            .arg(busySec, 0, 'f', 3)
+            .arg(stats.blockedNs / 1e9, 0, 'f', 3)
+            .arg(busySec > 0 ? mb / busySec : 0.0, 0, 'f', 1)
+            .arg(wallNs > 0 ? mb / (wallNs / 1e9) : 0.0, 0, 'f', 1);
+}
+
+} // namespace
+
+ViewPipeline::ViewPipeline(const Settings& settings)
+    : m_settings(settings)
+{
+    if (m_settings.encoderThreads <= 0) {
+        m_settings.encoderThreads = QThread::idealThreadCount();
+    }
+    if (m_settings.queueSize <= 0) {
+        m_settings.queueSize = WorkerPool::shared().threadCount();
+    }
+}
+
+bool ViewPipeline::run(CalibrationFactory::PatternType type, int width, int height, int number, const FileNameProvider& fileName)
+{
+    std::vector<int> indices(static_cast<size_t>(qMax(number, 0)));
+    for (int i = 0; i < number; ++i) {
+        indices[i] = i;
+    }
+    return run(type, width, height, number, indices, fileName);
+}
+
+bool ViewPipeline::run(CalibrationFactory::PatternType type, int width, int height, int number, const std::vector<int>& indices,
+                       const FileNameProvider& fileName)
+{
+    for (auto* stats : {&m_render, &m_encode, &m_write}) {
+        stats->items = 0;
+        stats->bytes = 0;
+        stats->busyNs = 0;
+        stats->blockedNs = 0;
+    }
+
+    QElapsedTimer wallTimer;
+    wallTimer.start();
+
+    BoundedQueue<RenderedView> encodeQueue {static_cast<size_t>(m_settings.queueSize)};
+    BoundedQueue<EncodedView> writeQueue {static_cast<size_t>(m_settings.queueSize)};
+    std::atomic<bool> failed {false};
+
+    // once failed, stages keep draining their queues so nobody stays blocked
+    std::vector<std::thread> encoders;
+    for (int i = 0; i < m_settings.encoderThreads; ++i) {
+        encoders.emplace_back([&] {
+            RenderedView view;
+            while (encodeQueue.pop(view)) {
+                if (failed) {
+                    continue;
+                }
+
+                QElapsedTimer timer;
+                timer.start();
+                EncodedView encoded {view.index, view.fileName, {}};
+                if (!encode(view, encoded.data)) {
+                    qWarning() << "Failed to encode image " << view.fileName;
+                    failed = true;
+                    continue;
+                }
+                view.image = QImage{};
+                m_encode.busyNs += timer.nsecsElapsed();
+                m_encode.items++;
+                m_encode.bytes += encoded.data.size();
+
+                timer.restart();
+                writeQueue.push(std::move(encoded));
+                m_encode.blockedNs += timer.nsecsElapsed();
+            }
+        });
+    }
+
+    std::thread writer {[&] {
+        EncodedView view;
+        while (writeQueue.pop(view)) {
+            if (failed) {
+                continue;
+            }
+
+            QElapsedTimer timer;
+            timer.start();
+            if (!write(view)) {
+                qWarning() << "Failed to save image at " << view.fileName;
+                failed = true;
+                continue;
+            }
+            m_write.busyNs += timer.nsecsElapsed();
+            m_write.items++;
+            m_write.bytes += view.data.size();
+            qDebug() << "Success. Please find image at " << view.fileName;
+        }
+    }};
+
+    QElapsedTimer renderTimer;
+    renderTimer.start();
+    const bool rendered = CalibrationFactory::forEachView(type, width, height, number, indices, [&](int i, const QImage& image) {
+        if (failed) {
+            return false;
+        }
+        m_render.items++;
+        m_render.bytes += image.sizeInBytes();
+
+        QElapsedTimer timer;
+        timer.start();
+        const bool queued = encodeQueue.push(RenderedView{i, fileName(i), image});
+        m_render.blockedNs += timer.nsecsElapsed();
+        return queued;
+    });
+    m_render.busyNs = renderTimer.nsecsElapsed() * WorkerPool::shared().threadCount() - m_render.blockedNs;
+
+    encodeQueue.close();
+    for (auto& encoder : encoders) {
+        encoder.join();
+    }
+    writeQueue.close();
+    writer.join();
+
+    m_wallNs = wallTimer.nsecsElapsed();
+    return rendered && !failed;
+}
+
+QString ViewPipeline::report() const
+{
+    return QString{"wall %1 s\n%2\n%3\n%4"}
+            .arg(m_wallNs / 1e9, 0, 'f', 3)
+            .arg(formatStage("render", m_render, m_wallNs),
+                 formatStage("encode", m_encode, m_wallNs),
+                 formatStage("write", m_write, m_wallNs));
+}
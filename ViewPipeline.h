@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#include <QString>
+
+#include "CalibrationFactory.h"
+
+/**
+ * Renders views, encodes and writes them in three overlapping stages:
+ * rendering threads of the factory -> encoder threads -> single writer thread.
+ * Stages are connected by bounded queues, so a slow stage holds back the
+ * previous ones instead of letting rendered views pile up in memory.
+ */
+class ViewPipeline
+{
+public:
+    struct Settings
+    {
+        int encoderThreads = 0; // 0 - ideal thread count
+        int queueSize = 0;      // views in flight per queue, 0 - one per rendering thread
+    };
+
+    struct StageStats
+    {
+        std::atomic<qint64> items {0};
+        std::atomic<qint64> bytes {0};
+        std::atomic<qint64> busyNs {0};   // time spent doing the stage work
+        std::atomic<qint64> blockedNs {0}; // time spent waiting for the next stage
+    };
+
+    using FileNameProvider = std::function<QString(int index)>;
+
+    explicit ViewPipeline(const Settings& settings);
+
+    /**
+     * @brief run - renders 'number' views and writes each of them to a file named by 'fileName'
+     * @return true if all views were written
+     */
+    bool run(CalibrationFactory::PatternType type, int width, int height, int number, const FileNameProvider& fileName);
+
+    /**
+     * @brief run - renders and writes only the views of 'number' listed in 'indices'
+     */
+    bool run(CalibrationFactory::PatternType type, int width, int height, int number, const std::vector<int>& indices,
+             const FileNameProvider& fileName);
+
+    /**
+     * @brief report - per stage counters of the last run, human readable
+     */
+    QString report() const;
+
+private:
+    Settings m_settings;
+    StageStats m_render;
+    StageStats m_encode;
+    StageStats m_write;
+    qint64 m_wallNs = 0;
+};
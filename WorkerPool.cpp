@@ -0,0 +1,148 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <atomic>
+
+#include <QThread>
+
+struct WorkerPool::Batch
+{
+    Batch(const std::function<void(int)>& task, int count)
+        : task(task)
+        , count(count)
+    {}
+
+    bool hasPending() const
+    {
+        return next.load() < count;
+    }
+
+    const std::function<void(int)>& task;
+    const int count;
+    std::atomic<int> next {0};
+    std::atomic<int> done {0};
+    std::mutex mutex;
+    std::condition_variable finished;
+};
+
+namespace {
+
+std::mutex sharedPoolMutex;
+std::unique_ptr<WorkerPool> sharedPool;
+int sharedThreadCount = 0;
+
+} // namespace
+
+WorkerPool::WorkerPool(int threadCount)
+{
+    if (threadCount <= 0) {
+        threadCount = QThread::idealThreadCount();
+    }
+
+    // the thread submitting a batch is one of the workers
+    for (int i = 1; i < threadCount; ++i) {
+        m_workers.emplace_back(&WorkerPool::workerLoop, this);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock {m_mutex};
+        m_stop = true;
+    }
+    m_wakeUp.notify_all();
+
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+int WorkerPool::threadCount() const
+{
+    return static_cast<int>(m_workers.size()) + 1;
+}
+
+void WorkerPool::run(int count, const std::function<void(int)>& task)
+{
+    if (count <= 0) {
+        return;
+    }
+
+    if (m_workers.empty() || count == 1) {
+        for (int i = 0; i < count; ++i) {
+            task(i);
+        }
+        return;
+    }
+
+    auto batch = std::make_shared<Batch>(task, count);
+    {
+        std::lock_guard<std::mutex> lock {m_mutex};
+        m_batches.push_back(batch);
+    }
+    m_wakeUp.notify_all();
+
+    process(*batch);
+
+    {
+        std::unique_lock<std::mutex> lock {batch->mutex};
+        batch->finished.wait(lock, [&batch] { return batch->done.load() == batch->count; });
+    }
+
+    std::lock_guard<std::mutex> lock {m_mutex};
+    m_batches.erase(std::remove(m_batches.begin(), m_batches.end(), batch), m_batches.end());
+}
+
+WorkerPool& WorkerPool::shared()
+{
+    std::lock_guard<std::mutex> lock {sharedPoolMutex};
+    if (!sharedPool) {
+        sharedPool.reset(new WorkerPool{sharedThreadCount});
+    }
+    return *sharedPool;
+}
+
+void WorkerPool::setSharedThreadCount(int threadCount)
+{
+    std::lock_guard<std::mutex> lock {sharedPoolMutex};
+    if (sharedThreadCount != threadCount || !sharedPool) {
+        sharedThreadCount = threadCount;
+        sharedPool.reset();
+    }
+}
+
+void WorkerPool::workerLoop()
+{
+    for (;;) {
+        std::shared_ptr<Batch> batch;
+        {
+            std::unique_lock<std::mutex> lock {m_mutex};
+            m_wakeUp.wait(lock, [this] {
+                return m_stop || std::any_of(m_batches.begin(), m_batches.end(),
+                                             [](const std::shared_ptr<Batch>& b) { return b->hasPending(); });
+            });
+
+            if (m_stop) {
+                return;
+            }
+
+            // batches are served in submission order
+            batch = *std::find_if(m_batches.begin(), m_batches.end(),
+                                  [](const std::shared_ptr<Batch>& b) { return b->hasPending(); });
+        }
+        process(*batch);
+    }
+}
+
+void WorkerPool::process(Batch& batch)
+{
+    for (int i = batch.next++; i < batch.count; i = batch.next++) {
+        batch.task(i);
+
+        if (++batch.done == batch.count) {
+            std::lock_guard<std::mutex> lock {batch.mutex};
+            batch.finished.notify_all();
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of worker threads running batches of indexed tasks.
+ * Idle workers take the next free index of the oldest unfinished batch and
+ * the thread submitting a batch works on it as well, so a task may submit
+ * a nested batch without starving the pool.
+ */
+class WorkerPool
+{
+public:
+    /**
+     * @brief WorkerPool - creates pool running tasks on 'threadCount' threads
+     *                     including the submitting one, 0 - ideal thread count
+     */
+    explicit WorkerPool(int threadCount = 0);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    int threadCount() const;
+
+    /**
+     * @brief run - calls 'task' for every index in [0, count) and returns when all of them are done
+     * @param count - number of task indices
+     * @param task - task to be called, may be called concurrently from different threads
+     */
+    void run(int count, const std::function<void(int index)>& task);
+
+    /**
+     * @brief shared - process wide pool used by the calibration factory
+     */
+    static WorkerPool& shared();
+
+    /**
+     * @brief setSharedThreadCount - resizes shared pool, must not be called while it runs tasks
+     * @param threadCount - number of threads, 0 - ideal thread count
+     */
+    static void setSharedThreadCount(int threadCount);
+
+private:
+    struct Batch;
+
+    void workerLoop();
+    static void process(Batch& batch);
+
+    std::vector<std::thread> m_workers;
+    std::deque<std::shared_ptr<Batch>> m_batches;
+    std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+    bool m_stop = false;
+};
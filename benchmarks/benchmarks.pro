@@ -0,0 +1,38 @@
+QT += gui svg
+
+CONFIG += c++14 console
+CONFIG -= app_bundle
+
+LIBS += -lz
+
+TARGET = CalibrationBenchmarks
+INCLUDEPATH += ..
+
+SOURCES += \
+        main.cpp \
+        ../CalibrationFactory.cpp \
+        ../DisplayList.cpp \
+        ../GlyphAtlas.cpp \
+        ../ImageEncoder.cpp \
+        ../Interleaver.cpp \
+        ../MappedImage.cpp \
+        ../PatternBackends.cpp \
+        ../PngStreamWriter.cpp \
+        ../Profiler.cpp \
+        ../RasterKernels.cpp \
+        ../StampCache.cpp \
+        ../WorkerPool.cpp
+
+HEADERS += \
+        ../CalibrationFactory.h \
+        ../DisplayList.h \
+        ../GlyphAtlas.h \
+        ../ImageEncoder.h \
+        ../Interleaver.h \
+        ../MappedImage.h \
+        ../PatternBackends.h \
+        ../PngStreamWriter.h \
+        ../Profiler.h \
+        ../RasterKernels.h \
+        ../StampCache.h \
+        ../WorkerPool.h
@@ -0,0 +1,495 @@
+#include <QGuiApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include "CalibrationFactory.h"
+#include "ImageEncoder.h"
+#include "Interleaver.h"
+#include "RasterKernels.h"
+
+#include <QBuffer>
+#include <QDebug>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+#include <QTemporaryDir>
+
+#include <atomic>
+#include <cstdlib>
+#include <limits>
+#include <new>
+#include <utility>
+
+#include <sys/resource.h>
+
+namespace {
+
+std::atomic<quint64> allocationCount {0};
+
+} // namespace
+
+// counts allocations made through operator new, Qt containers and pixel buffers use malloc directly
+void* operator new(std::size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* pointer = std::malloc(size ? size : 1)) {
+        return pointer;
+    }
+    throw std::bad_alloc{};
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+namespace {
+
+struct Size {
+    int width;
+    int height;
+};
+
+struct Grid {
+    int rows;
+    int columns;
+};
+
+struct Pattern {
+    CalibrationFactory::PatternType type;
+    const char* name;
+};
+
+const std::vector<Pattern> PATTERNS = {
+    {CalibrationFactory::RGB, "rgb"},
+    {CalibrationFactory::ACT, "act"},
+    {CalibrationFactory::ALIGN_BAR, "abar"}
+};
+
+const std::vector<Size> SIZES = {{1920, 1080}, {3840, 2160}, {7680, 4320}, {15360, 8640}};
+const std::vector<Size> QUICK_SIZES = {{1920, 1080}, {3840, 2160}};
+const std::vector<Grid> GRIDS = {{2, 2}, {8, 8}};
+const std::vector<int> VIEW_COUNTS = {2, 4, 8};
+
+// view strips of the legacy path grow with the number of views, larger views would not fit in memory
+const int MAX_VIEW_WIDTH = 3840;
+
+/**
+ * Best time of the repeats along with what the last repeat allocated.
+ */
+struct Measurement {
+    qint64 ns = std::numeric_limits<qint64>::max();
+    quint64 allocations = 0;
+    bool ok = true;
+};
+
+long peakRssKb()
+{
+    rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+template <typename Function>
+Measurement measure(int repeats, Function function)
+{
+    Measurement result;
+    for (int i = 0; i < repeats; ++i) {
+        const quint64 allocations = allocationCount.load();
+        QElapsedTimer timer;
+        timer.start();
+        result.ok = function() && result.ok;
+        result.ns = qMin(result.ns, timer.nsecsElapsed());
+        result.allocations = allocationCount.load() - allocations;
+    }
+    return result;
+}
+
+class Report
+{
+public:
+    void add(const QString& stage, const char* pattern, const Size& size, const Grid& grid, int views,
+             qint64 bytes, const Measurement& measurement)
+    {
+        const qint64 pixels = static_cast<qint64>(size.width) * size.height * views;
+        const double nsPerPixel = pixels > 0 ? static_cast<double>(measurement.ns) / pixels : 0.0;
+        const double megabytesPerSecond = measurement.ns > 0 ? bytes / 1e6 / (measurement.ns / 1e9) : 0.0;
+        const long rss = peakRssKb();
+
+        qInfo().noquote() << QString{"%1 %2 %3x%4 grid %5x%6 x%7: %8 ms, %9 ns/pixel, %10 MB/s, %11 allocations, peak rss %12 MB%13"}
+                             .arg(stage, -12).arg(pattern, -4)
+                             .arg(size.width).arg(size.height).arg(grid.rows).arg(grid.columns).arg(views)
+                             .arg(measurement.ns / 1e6, 0, 'f', 2)
+                             .arg(nsPerPixel, 0, 'f', 3)
+                             .arg(megabytesPerSecond, 0, 'f', 1)
+                             .arg(measurement.allocations)
+                             .arg(rss / 1024)
+                             .arg(measurement.ok ? "" : " FAILED");
+
+        m_results.append(QJsonObject{
+            {"stage", stage},
+            {"pattern", pattern},
+            {"width", size.width},
+            {"height", size.height},
+            {"rows", grid.rows},
+            {"columns", grid.columns},
+            {"views", views},
+            {"ns", measurement.ns},
+            {"nsPerPixel", nsPerPixel},
+            {"bytes", bytes},
+            {"megabytesPerSecond", megabytesPerSecond},
+            {"allocations", static_cast<qint64>(measurement.allocations)},
+            {"peakRssKb", static_cast<qint64>(rss)},
+            {"ok", measurement.ok}
+        });
+        m_failed = m_failed || !measurement.ok;
+    }
+
+    bool failed() const
+    {
+        return m_failed;
+    }
+
+    QByteArray toJson(int threads, int repeats) const
+    {
+        const QJsonObject root {
+            {"generator", CalibrationFactory::generatorVersion()},
+            {"instructionSet", RasterKernels::instructionSet()},
+            {"threads", threads},
+            {"repeats", repeats},
+            {"results", m_results}
+        };
+        return QJsonDocument{root}.toJson();
+    }
+
+private:
+    QJsonArray m_results;
+    bool m_failed = false;
+};
+
+// renderPattern gives indexed images their palette
+QImage createImage(CalibrationFactory::PatternType type, int width, int height)
+{
+    return QImage{width, height, CalibrationFactory::patternFormat(type)};
+}
+
+/**
+ * Single pattern rendered over a reused image, pattern implementation and band split only.
+ */
+void benchRender(Report& report, const Pattern& pattern, const Size& size, int repeats)
+{
+    QImage image = createImage(pattern.type, size.width, size.height);
+    for (const auto& grid : GRIDS) {
+        const auto measurement = measure(repeats, [&] {
+            return CalibrationFactory::renderPattern(pattern.type, image, grid.rows, grid.columns);
+        });
+        report.add("render", pattern.name, size, grid, 1, image.sizeInBytes(), measurement);
+    }
+}
+
+/**
+ * Box downsampling of a rendered pattern into the levels of a resolution pyramid,
+ * single threaded kernel only.
+ */
+void benchDownsample(Report& report, const Pattern& pattern, const Size& size, int repeats)
+{
+    const Grid grid {2, 2};
+    QImage image = createImage(pattern.type, size.width, size.height);
+    if (!RasterKernels::supportsDownsampling(image.format()) ||
+        !CalibrationFactory::renderPattern(pattern.type, image, grid.rows, grid.columns)) {
+        return;
+    }
+
+    const int bytesPerPixel = image.depth() / 8;
+    for (const int factor : {2, 4}) {
+        QImage level = createImage(pattern.type, size.width / factor, size.height / factor);
+        const auto measurement = measure(repeats, [&] {
+            for (int y = 0; y < level.height(); ++y) {
+                RasterKernels::boxDownsampleRow(level.scanLine(y), image.constScanLine(y * factor), image.bytesPerLine(),
+                                                level.width(), bytesPerPixel, factor);
+            }
+            return true;
+        });
+        report.add(QString{"downsample/%1"}.arg(factor), pattern.name, size, grid, 1, image.sizeInBytes(), measurement);
+    }
+}
+
+/**
+ * Views through getPattern and through the removed strip-and-split path: the whole
+ * 'views' x 1 strip rendered at once and every view copied out of it. Then views
+ * interleaved into a single panel image.
+ */
+void benchViews(Report& report, const Pattern& pattern, const Size& size, int repeats)
+{
+    for (const int views : VIEW_COUNTS) {
+        const Grid grid {1, views};
+        const qint64 bytes = static_cast<qint64>(size.width) * size.height * views *
+                             QImage::toPixelFormat(CalibrationFactory::patternFormat(pattern.type)).bitsPerPixel() / 8;
+
+        const auto direct = measure(repeats, [&] {
+            return CalibrationFactory::getPattern(pattern.type, size.width, size.height, views).size() == static_cast<size_t>(views);
+        });
+        report.add("getPattern", pattern.name, size, grid, views, bytes, direct);
+
+        const auto split = measure(repeats, [&] {
+            QImage strip = createImage(pattern.type, size.width * views, size.height);
+            if (!CalibrationFactory::renderPattern(pattern.type, strip, 1, views)) {
+                return false;
+            }
+
+            std::vector<QImage> result;
+            for (int i = 0; i < views; ++i) {
+                result.push_back(strip.copy(size.width * i, 0, size.width, size.height));
+            }
+            return result.size() == static_cast<size_t>(views);
+        });
+        report.add("splitImage", pattern.name, size, grid, views, bytes, split);
+
+        // typical slanted sheet, the map is built once per panel and not timed
+        Interleaver::Lenticular lens;
+        lens.slant = 1.0 / 3;
+        lens.pitch = views;
+        const Interleaver interleaver = Interleaver::lenticular(QSize{size.width, size.height}, views, lens);
+        QImage composite {size.width, size.height, QImage::Format_RGB888};
+        const auto interleaved = measure(repeats, [&] {
+            return CalibrationFactory::interleave(pattern.type, interleaver, composite);
+        });
+        report.add("interleave", pattern.name, size, grid, views, composite.sizeInBytes(), interleaved);
+    }
+}
+
+/**
+ * Encoding into memory by every encoder backend and writing of the encoded PNG
+ * bytes, timed apart.
+ */
+void benchEncode(Report& report, const Pattern& pattern, const Size& size, int repeats, const QTemporaryDir& directory)
+{
+    const Grid grid {2, 2};
+    QImage image = createImage(pattern.type, size.width, size.height);
+    if (!CalibrationFactory::renderPattern(pattern.type, image, grid.rows, grid.columns)) {
+        report.add("encode", pattern.name, size, grid, 1, 0, Measurement{0, 0, false});
+        return;
+    }
+
+    const std::vector<std::pair<ImageEncoder::Backend, QString>> encoders = {
+        {ImageEncoder::QT, "png"},
+        {ImageEncoder::PNG, "png"},
+        {ImageEncoder::FAST_PNG, "png"},
+        {ImageEncoder::PPM, "ppm"},
+        {ImageEncoder::BMP, "bmp"},
+        {ImageEncoder::QOI, "qoi"}
+    };
+
+    QByteArray encoded;
+    for (const auto& encoder : encoders) {
+        ImageEncoder::Settings settings;
+        settings.backend = encoder.first;
+
+        const auto encode = measure(repeats, [&] {
+            encoded.clear();
+            QBuffer buffer {&encoded};
+            buffer.open(QIODevice::WriteOnly);
+            return ImageEncoder::encode(image, settings, encoder.second, &buffer);
+        });
+        report.add("encode " + ImageEncoder::backendName(encoder.first), pattern.name, size, grid, 1, image.sizeInBytes(), encode);
+    }
+
+    // the bytes of the default encoder are written
+    encoded.clear();
+    QBuffer buffer {&encoded};
+    buffer.open(QIODevice::WriteOnly);
+    ImageEncoder::encode(image, ImageEncoder::Settings{}, "png", &buffer);
+
+    const QString filePath = directory.filePath(QString{"%1.png"}.arg(pattern.name));
+    const auto write = measure(repeats, [&] {
+        QFile file {filePath};
+        return file.open(QIODevice::WriteOnly) && file.write(encoded) == encoded.size();
+    });
+    report.add("write", pattern.name, size, grid, 1, encoded.size(), write);
+}
+
+/**
+ * ACT painted by QPainter against ACT written by the raster kernels.
+ */
+int maxChannelDifference(const std::vector<QImage>& first, const std::vector<QImage>& second)
+{
+    int result = 0;
+    for (size_t i = 0; i < first.size() && i < second.size(); ++i) {
+        // painted and rasterized views may come in different formats
+        const QImage firstView = first[i].convertToFormat(QImage::Format_ARGB32);
+        const QImage secondView = second[i].convertToFormat(QImage::Format_ARGB32);
+        for (int y = 0; y < firstView.height(); ++y) {
+            const auto* a = reinterpret_cast<const QRgb*>(firstView.constScanLine(y));
+            const auto* b = reinterpret_cast<const QRgb*>(secondView.constScanLine(y));
+            for (int x = 0; x < firstView.width(); ++x) {
+                result = qMax(result, qAbs(qRed(a[x]) - qRed(b[x])));
+                result = qMax(result, qAbs(qGreen(a[x]) - qGreen(b[x])));
+                result = qMax(result, qAbs(qBlue(a[x]) - qBlue(b[x])));
+                result = qMax(result, qAbs(qAlpha(a[x]) - qAlpha(b[x])));
+            }
+        }
+    }
+    return result;
+}
+
+bool compareActRasterizers(Report& report, const Size& size, int repeats)
+{
+    const int views = 4;
+    std::vector<QImage> painted;
+    std::vector<QImage> rasterized;
+
+    CalibrationFactory::setFastRasterEnabled(false);
+    const auto painter = measure(repeats, [&] {
+        painted = CalibrationFactory::getPattern(CalibrationFactory::ACT, size.width, size.height, views);
+        return !painted.empty();
+    });
+    CalibrationFactory::setFastRasterEnabled(true);
+    const auto raster = measure(repeats, [&] {
+        rasterized = CalibrationFactory::getPattern(CalibrationFactory::ACT, size.width, size.height, views);
+        return !rasterized.empty();
+    });
+
+    // both paths render in their own format, so the bytes written differ
+    report.add("act-qpainter", "act", size, Grid{1, views}, views, painted.empty() ? 0 : painted.front().sizeInBytes() * views, painter);
+    report.add("act-raster", "act", size, Grid{1, views}, views, rasterized.empty() ? 0 : rasterized.front().sizeInBytes() * views, raster);
+
+    const int difference = maxChannelDifference(painted, rasterized);
+    qInfo().noquote() << QString{"act %1x%2 x%3: max channel difference %4 (tolerance %5)"}
+                         .arg(size.width).arg(size.height).arg(views)
+                         .arg(difference)
+                         .arg(RasterKernels::SHADE_TOLERANCE);
+    return difference <= RasterKernels::SHADE_TOLERANCE;
+}
+
+/**
+ * Whole invocations of the command line tool for a small image, where process start-up
+ * dominates, with the GUI application and in headless mode.
+ */
+void benchColdStart(Report& report, const QString& program, int repeats, const QTemporaryDir& directory)
+{
+    const Size size {640, 480};
+    const Grid grid {2, 2};
+    const std::vector<std::pair<const char*, QStringList>> modes = {
+        {"cold-start", {}},
+        {"cold-start-headless", {"--headless"}}
+    };
+
+    for (const auto& pattern : PATTERNS) {
+        const QString type = QString{"%1%2x%3"}.arg(pattern.name).arg(grid.columns).arg(grid.rows);
+        const QString destination = directory.filePath(QString{"cold-%1.png"}.arg(pattern.name));
+
+        for (const auto& mode : modes) {
+            const QStringList arguments = mode.second + QStringList{"--no-cache", "-t", type, "--width", QString::number(size.width),
+                                                                   "--height", QString::number(size.height), destination};
+            const auto measurement = measure(repeats, [&] {
+                QProcess process;
+                process.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+                process.start(program, arguments);
+                return process.waitForFinished(-1) && process.exitStatus() == QProcess::NormalExit && process.exitCode() == 0;
+            });
+            report.add(mode.first, pattern.name, size, grid, 1, 0, measurement);
+        }
+    }
+}
+
+namespace Keywords {
+    const QString json = "json";
+    const QString jobs = "jobs";
+    const QString repeats = "repeats";
+    const QString quick = "quick";
+    const QString coldStart = "cold-start";
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QGuiApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Times rendering, view splitting, encoding and writing of calibration patterns");
+    parser.addHelpOption();
+    parser.addOption({Keywords::json, "Write results as JSON to <file>, '-' for standard output", "file"});
+    parser.addOption({{"j", Keywords::jobs}, "Rendering threads, 0 - ideal thread count. Default 1", "int", "1"});
+    parser.addOption({Keywords::repeats, "Runs of every case, the best one is reported. Default 3", "positive int", "3"});
+    parser.addOption({Keywords::quick, "Sweep resolutions up to 4K only"});
+    parser.addOption({Keywords::coldStart, "Also time whole runs of the CalibrationImageFactory executable at <path>", "path"});
+    parser.process(app);
+
+    bool ok = false;
+    const int threads = parser.value(Keywords::jobs).toInt(&ok);
+    if (!ok || threads < 0) {
+        qWarning() << "Jobs should be non negative integer";
+        return EXIT_FAILURE;
+    }
+
+    const int repeats = parser.value(Keywords::repeats).toInt(&ok);
+    if (!ok || repeats <= 0) {
+        qWarning() << "Repeats should be positive integer";
+        return EXIT_FAILURE;
+    }
+
+    QTemporaryDir directory;
+    if (!directory.isValid()) {
+        qWarning() << "Failed to create directory for written images";
+        return EXIT_FAILURE;
+    }
+
+    // a single thread by default, so the numbers compare the code and not the scheduling
+    CalibrationFactory::setThreadCount(threads);
+    qInfo() << "raster kernels:" << RasterKernels::instructionSet();
+
+    Report report;
+    bool withinTolerance = true;
+    for (const auto& size : parser.isSet(Keywords::quick) ? QUICK_SIZES : SIZES) {
+        for (const auto& pattern : PATTERNS) {
+            benchRender(report, pattern, size, repeats);
+            benchDownsample(report, pattern, size, repeats);
+            if (size.width <= MAX_VIEW_WIDTH) {
+                benchViews(report, pattern, size, repeats);
+            }
+            benchEncode(report, pattern, size, repeats, directory);
+        }
+
+        if (size.width <= MAX_VIEW_WIDTH) {
+            withinTolerance = compareActRasterizers(report, size, repeats) && withinTolerance;
+        }
+    }
+
+    if (parser.isSet(Keywords::coldStart)) {
+        benchColdStart(report, parser.value(Keywords::coldStart), repeats, directory);
+    }
+
+    if (parser.isSet(Keywords::json)) {
+        const QString path = parser.value(Keywords::json);
+        QFile file {path};
+        const bool opened = path == "-" ? file.open(stdout, QIODevice::WriteOnly) : file.open(QIODevice::WriteOnly);
+        if (!opened || file.write(report.toJson(threads, repeats)) < 0) {
+            qWarning() << "Failed to write results to " << path;
+            return EXIT_FAILURE;
+        }
+    }
+
+    return report.failed() || !withinTolerance ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -1,20 +1,72 @@
 #include <QGuiApplication>
 #include <QCommandLineParser>
+#include "BatchManifest.h"
 #include "CalibrationFactory.h"
+#include "FrameStream.h"
+#include "ImageEncoder.h"
+#include "Interleaver.h"
+#include "MappedImage.h"
+#include "PatternCache.h"
+#include "PatternServer.h"
+#include "Profiler.h"
+#include "RasterKernels.h"
+#include "ShardManifest.h"
+#include "StampCache.h"
+#include "ViewPipeline.h"
 
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
 #include <QFileInfo>
+#include <QSharedMemory>
+
+#include <map>
+#include <memory>
 
 namespace Keywords {
     const QString t = "t";
     const QString type = "type";
     const QString w = "width";
     const QString h = "height";
+    const QString j = "j";
+    const QString jobs = "jobs";
+    const QString encodeJobs = "encode-jobs";
+    const QString queue = "queue";
+    const QString stats = "stats";
+    const QString noFastRaster = "no-fast-raster";
+    const QString noGlyphAtlas = "no-glyph-atlas";
+    const QString noStampCache = "no-stamp-cache";
+    const QString noViewDeltas = "no-view-deltas";
+    const QString argb32 = "argb32";
+    const QString cacheDir = "cache-dir";
+    const QString cacheSize = "cache-size";
+    const QString noCache = "no-cache";
+    const QString stream = "stream";
+    const QString bandHeight = "band-height";
+    const QString profile = "profile";
+    const QString manifest = "manifest";
+    const QString serve = "serve";
+    const QString request = "request";
+    const QString headless = "headless";
+    const QString encoder = "encoder";
+    const QString level = "level";
+    const QString mmap = "mmap";
+    const QString sync = "sync";
+    const QString interleave = "interleave";
+    const QString interleaveLut = "interleave-lut";
+    const QString shard = "shard";
+    const QString shardManifest = "shard-manifest";
+    const QString verifyShards = "verify-shards";
+    const QString pyramid = "pyramid";
+    const QString pyramidMinLabel = "pyramid-min-label";
+    const QString pipeFormat = "pipe-format";
     const QString rgb = "rgb";
     const QString act = "act";
     const QString abar = "abar";
 }
 
+const QString DEFAULT_TYPE = "rgb3x4";
+
 enum class PatternType {
     RGB = CalibrationFactory::PatternType::RGB,
     ACT = CalibrationFactory::PatternType::ACT,
@@ -68,31 +120,805 @@ PatternType getPatternType(const QString& str, SizeParams& size) {
     return PatternType::UNKNOWN;
 }
 
-void makeViews(const QString& baseName, const std::vector<QImage>& images)
+QString viewFileName(const QString& baseName, int index)
 {
     QFileInfo info {baseName};
     const char DOT = '.';
 
 
     const QString extension = info.completeSuffix().size() > 0 ? DOT + info.completeSuffix() : "";
+    return baseName.mid(0, baseName.size() - extension.size()) +
+            QString::number(index) + extension;
+}
 
-    for (size_t i = 0; i < images.size(); ++i)
-    {
-        QString imageName = baseName.mid(0, baseName.size() - extension.size()) +
-                QString::number(i) + extension;
+/**
+ * Level of a resolution pyramid is saved next to the master, with its size appended
+ * to the base name.
+ */
+QString levelFileName(const QString& baseName, int width, int height)
+{
+    const QFileInfo info {baseName};
+    const QString extension = info.completeSuffix().size() > 0 ? '.' + info.completeSuffix() : "";
+    return baseName.mid(0, baseName.size() - extension.size()) + QString{"_%1x%2"}.arg(width).arg(height) + extension;
+}
+
+PatternCache::Key cacheKey(PatternType type, const QString& filePath, int width, int height, const SizeParams& size, int viewIndex = 0)
+{
+    PatternCache::Key key;
+    key.type = static_cast<int>(type);
+    key.width = width;
+    key.height = height;
+    key.rows = size.rows;
+    key.columns = size.columns;
+    key.views = size.viewsNumber;
+    key.viewIndex = viewIndex;
+    key.format = QFileInfo{filePath}.suffix();
+    key.encoder = ImageEncoder::describe(CalibrationFactory::encoder());
+    return key;
+}
+
+bool fetchViews(const PatternCache& cache, const QString& baseName, PatternType type, int width, int height, const SizeParams& size,
+                const std::vector<int>& views)
+{
+    for (const int i : views) {
+        const QString imageName = viewFileName(baseName, i);
+        if (!cache.fetch(PatternCache::hash(cacheKey(type, imageName, width, height, size, i)), imageName)) {
+            return false;
+        }
+    }
+
+    for (const int i : views) {
+        qDebug() << "Success. Please find cached image at " << viewFileName(baseName, i);
+    }
+    return true;
+}
+
+bool makeViews(const QString& baseName, PatternType type, int width, int height, const SizeParams& size, const std::vector<int>& views,
+               const ViewPipeline::Settings& settings, const PatternCache* cache, bool printStats)
+{
+    // a set is served from the cache only as a whole
+    if (cache && fetchViews(*cache, baseName, type, width, height, size, views)) {
+        return true;
+    }
+
+    // destination may be a hardlink into the cache, writing through it would alter the entry
+    if (cache) {
+        for (const int i : views) {
+            QFile::remove(viewFileName(baseName, i));
+        }
+    }
+
+    ViewPipeline pipeline {settings};
+    const bool result = pipeline.run(static_cast<CalibrationFactory::PatternType>(type), width, height, size.viewsNumber, views,
+                                     [&](int i) { return viewFileName(baseName, i); });
+
+    if (printStats) {
+        qInfo().noquote() << pipeline.report();
+    }
+
+    if (result && cache) {
+        for (const int i : views) {
+            const QString imageName = viewFileName(baseName, i);
+            cache->insert(PatternCache::hash(cacheKey(type, imageName, width, height, size, i)), imageName);
+        }
+    }
+    return result;
+}
+
+bool makeImage(PatternType type, const QString& filePath, int width, int height, const SizeParams& size)
+{
+    switch (type) {
+        case PatternType::ACT:
+            if (!CalibrationFactory::makeACT(filePath, width, height, size.rows, size.columns)) {
+                qWarning() << "ACT image creation failed";
+                return false;
+            }
+            break;
+
+        case PatternType::RGB:
+            if (!CalibrationFactory::makeRGB(filePath, width, height, size.rows, size.columns)) {
+                qWarning() << "RGB image creation failed";
+                return false;
+            }
+            break;
+
+        case PatternType::ALIGN_BAR:
+            if (!CalibrationFactory::makeABar(filePath, width, height, size.rows, size.columns)) {
+                qWarning() << "Alignment bar image creation failed";
+                return false;
+            }
+            break;
+
+        default:
+            qWarning() << "Bad calibration type provided";
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * Picks the encoder of 'filePath', warns about an encoder or a level not applying to it.
+ */
+bool resolveEncoder(const QString& filePath, bool streaming, ImageEncoder::Backend& backend)
+{
+    const auto encoder = CalibrationFactory::encoder();
+    const QString suffix = QFileInfo{filePath}.suffix();
+    if (!ImageEncoder::resolve(encoder.backend, suffix, backend, streaming)) {
+        qWarning() << "Encoder" << ImageEncoder::backendName(encoder.backend) << "does not write" << suffix << "files";
+        return false;
+    }
+
+    if (encoder.level >= 0 && !ImageEncoder::hasLevel(backend)) {
+        qWarning() << "Compression level is taken by png and fastpng encoders only, not by"
+                   << ImageEncoder::backendName(backend) << "writing" << suffix << "files";
+        return false;
+    }
+    return true;
+}
+
+bool makeStreamedImage(PatternType type, const QString& filePath, int width, int height, const SizeParams& size, int bandHeight)
+{
+    if (type == PatternType::UNKNOWN) {
+        qWarning() << "Bad calibration type provided";
+        return false;
+    }
+
+    ImageEncoder::Backend backend = ImageEncoder::AUTO;
+    if (!resolveEncoder(filePath, true, backend) || !ImageEncoder::isStreaming(backend)) {
+        qWarning() << "Stream mode writes PNG, PPM, BMP and QOI images only";
+        return false;
+    }
+
+    if (!CalibrationFactory::makePatternStreamed(static_cast<CalibrationFactory::PatternType>(type), filePath,
+                                                 width, height, size.rows, size.columns, bandHeight)) {
+        qWarning() << "Streamed image creation failed";
+        return false;
+    }
+    return true;
+}
+
+struct JobOptions
+{
+    ViewPipeline::Settings pipelineSettings;
+    const PatternCache* cache = nullptr;
+    bool printStats = false;
+    bool stream = false;
+    int bandHeight = 0;
+    bool mapped = false;
+    bool sync = false;
+    bool interleave = false;
+    Interleaver::Lenticular lens;
+    QImage lookupTable; // null - lenticular map of 'lens'
+    ShardManifest::Shard shard;
+    std::vector<int> pyramidFactors;
+    int pyramidMinLabel = 0;
+    FrameStream* frames = nullptr; // stdout stream of "-" destinations
+};
+
+/**
+ * Multi-view jobs write a file per view unless the views are interleaved into one.
+ */
+bool writesViews(const SizeParams& size, const JobOptions& options)
+{
+    return size.viewsNumber > 0 && !options.interleave;
+}
+
+int outputCount(const SizeParams& size, const JobOptions& options)
+{
+    return writesViews(size, options) ? size.viewsNumber : 1;
+}
+
+QString outputFileName(const BatchManifest::Job& job, const SizeParams& size, const JobOptions& options, int output)
+{
+    return writesViews(size, options) ? viewFileName(job.destination, output) : job.destination;
+}
+
+/**
+ * Outputs of a job the shard renders, 'firstUnit' numbers the first output of the
+ * job among all outputs of the run.
+ */
+std::vector<int> shardOutputs(int outputs, qint64 firstUnit, const ShardManifest::Shard& shard)
+{
+    std::vector<int> owned;
+    for (int i = 0; i < outputs; ++i) {
+        if (shard.owns(firstUnit + i)) {
+            owned.push_back(i);
+        }
+    }
+    return owned;
+}
+
+/**
+ * Renders the image, or the listed views, straight into memory mapped files. Mapped
+ * output is meant to be consumed in place, so it neither uses nor fills the cache.
+ */
+bool makeMappedImage(const BatchManifest::Job& job, PatternType type, const SizeParams& size, const std::vector<int>& views, bool sync)
+{
+    if (!MappedImage::isMappable(job.destination)) {
+        qWarning() << "Mapped output writes RAW, PPM, PGM and BMP images only";
+        return false;
+    }
+
+    Profiler::Scope scope {"render"};
+    const auto patternType = static_cast<CalibrationFactory::PatternType>(type);
+    const bool created = size.viewsNumber > 0
+            ? CalibrationFactory::makeViewsMapped(patternType, [&](int i) { return viewFileName(job.destination, i); },
+                                                  job.width, job.height, size.viewsNumber, views, sync)
+            : CalibrationFactory::makePatternMapped(patternType, job.destination, job.width, job.height,
+                                                    size.rows, size.columns, sync);
+    if (!created) {
+        qWarning() << "Mapped image creation failed";
+        return false;
+    }
+
+    qDebug() << "Success. Please find image at " << job.destination;
+    return true;
+}
+
+/**
+ * Panel map of the job size from the lenticular settings or the lookup table.
+ */
+bool createInterleaver(const BatchManifest::Job& job, const SizeParams& size, const JobOptions& options, Interleaver& interleaver)
+{
+    if (size.viewsNumber <= 0) {
+        qWarning() << "Interleaving needs a multi-view pattern type e.g." << Keywords::abar + "45";
+        return false;
+    }
+
+    if (size.viewsNumber > Interleaver::MAX_VIEWS) {
+        qWarning() << "At most" << Interleaver::MAX_VIEWS << "views can be interleaved";
+        return false;
+    }
+
+    const QSize panelSize {job.width, job.height};
+    if (!options.lookupTable.isNull() && options.lookupTable.size() != panelSize) {
+        qWarning() << "Interleave lookup table size differs from image size";
+        return false;
+    }
+
+    interleaver = options.lookupTable.isNull()
+            ? Interleaver::lenticular(panelSize, size.viewsNumber, options.lens)
+            : Interleaver::fromLookupTable(options.lookupTable, size.viewsNumber);
+    if (!interleaver.isValid()) {
+        qWarning() << "Interleave lookup table refers to views beyond" << size.viewsNumber;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Interleaves all the views of the job into a single panel native image. The composite
+ * depends on the panel map besides the job, so it neither uses nor fills the cache.
+ */
+bool makeInterleavedImage(const BatchManifest::Job& job, PatternType type, const SizeParams& size, const JobOptions& options)
+{
+    Interleaver interleaver;
+    if (!createInterleaver(job, size, options, interleaver)) {
+        return false;
+    }
+
+    Profiler::Scope scope {"render"};
+    if (!CalibrationFactory::makeInterleaved(static_cast<CalibrationFactory::PatternType>(type), job.destination, interleaver)) {
+        qWarning() << "Interleaved image creation failed";
+        return false;
+    }
+
+    qDebug() << "Success. Please find image at " << job.destination;
+    return true;
+}
+
+/**
+ * Renders the master image once and derives the smaller levels from it. The levels
+ * depend on the factors besides the job, so they neither use nor fill the cache.
+ */
+bool makePyramidImages(const BatchManifest::Job& job, PatternType type, const SizeParams& size, const JobOptions& options)
+{
+    if (size.viewsNumber > 0) {
+        qWarning() << "Pyramid is made of single image types only";
+        return false;
+    }
+
+    std::vector<CalibrationFactory::PyramidLevel> levels;
+    for (const int factor : options.pyramidFactors) {
+        if (job.width % factor != 0 || job.height % factor != 0) {
+            qWarning() << "Pyramid factor" << factor << "does not divide" << job.width << "x" << job.height;
+            return false;
+        }
+        levels.push_back({factor, levelFileName(job.destination, job.width / factor, job.height / factor)});
+    }
+
+    Profiler::Scope scope {"render"};
+    if (!CalibrationFactory::makePyramid(static_cast<CalibrationFactory::PatternType>(type), job.destination, job.width, job.height,
+                                         size.rows, size.columns, levels, options.pyramidMinLabel)) {
+        qWarning() << "Pyramid creation failed";
+        return false;
+    }
+
+    qDebug() << "Success. Please find image at " << job.destination;
+    for (const auto& level : levels) {
+        qDebug() << "Success. Please find image at " << level.filePath;
+    }
+    return true;
+}
+
+/**
+ * Appends the image, the views in index order or the interleaved composite of the
+ * job to the stdout stream, every frame as soon as it is ready.
+ */
+bool streamFrames(const BatchManifest::Job& job, PatternType type, const SizeParams& size, const JobOptions& options)
+{
+    if (!options.frames) {
+        qWarning() << "Stdout stream is not available here";
+        return false;
+    }
+
+    if (options.mapped || options.stream || !options.pyramidFactors.empty() || options.shard.isSharded()) {
+        qWarning() << "Stdout stream excludes memory mapped, band streamed, pyramid and sharded output";
+        return false;
+    }
+
+    Profiler::Scope scope {"render"};
+    const auto patternType = static_cast<CalibrationFactory::PatternType>(type);
+    bool written = false;
+    if (options.interleave) {
+        Interleaver interleaver;
+        if (!createInterleaver(job, size, options, interleaver)) {
+            return false;
+        }
+
+        QImage composite {interleaver.size(), QImage::Format_RGB888};
+        written = CalibrationFactory::interleave(patternType, interleaver, composite) && options.frames->writeFrame(composite);
+    } else if (size.viewsNumber > 0) {
+        written = options.frames->writeViews(patternType, job.width, job.height, size.viewsNumber);
+    } else {
+        QImage image {job.width, job.height, CalibrationFactory::patternFormat(patternType)};
+        written = CalibrationFactory::renderPattern(patternType, image, size.rows, size.columns) && options.frames->writeFrame(image);
+    }
+
+    if (!written) {
+        qWarning() << "Streaming frames to stdout failed";
+        return false;
+    }
+
+    qDebug() << "Success." << options.frames->frameCount() << "frames streamed to stdout";
+    return true;
+}
+
+/**
+ * Generates the image, or the views, of a single job the shard of 'options' owns,
+ * 'firstUnit' numbers the first output of the job among all outputs of the run.
+ */
+bool runJob(const BatchManifest::Job& job, const JobOptions& options, qint64 firstUnit = 0)
+{
+    SizeParams size;
+    const auto type = getPatternType(job.type, size);
+    if (type == PatternType::UNKNOWN) {
+        qWarning() << "Bad calibration type provided";
+        return false;
+    }
+
+    if (FrameStream::isStreamPath(job.destination)) {
+        return streamFrames(job, type, size, options);
+    }
+
+    const std::vector<int> outputs = shardOutputs(outputCount(size, options), firstUnit, options.shard);
+    if (outputs.empty()) {
+        return true;
+    }
+
+    // views and composites are rendered whole, only single images are encoded band by band
+    if (options.stream && (size.viewsNumber > 0 || options.interleave)) {
+        qWarning() << "Stream is supported for single images only, not for views or interleaved composites";
+        return false;
+    }
+
+    if (options.mapped) {
+        return makeMappedImage(job, type, size, outputs, options.sync);
+    }
+
+    ImageEncoder::Backend backend = ImageEncoder::AUTO;
+    if (!resolveEncoder(job.destination, options.stream, backend)) {
+        return false;
+    }
+
+    if (options.interleave) {
+        return makeInterleavedImage(job, type, size, options);
+    }
+
+    if (!options.pyramidFactors.empty()) {
+        return makePyramidImages(job, type, size, options);
+    }
+
+    if (size.viewsNumber > 0) {
+        Profiler::Scope scope {"views"};
+        return makeViews(job.destination, type, job.width, job.height, size, outputs, options.pipelineSettings, options.cache, options.printStats);
+    }
+
+    QString hash;
+    if (options.cache) {
+        hash = PatternCache::hash(cacheKey(type, job.destination, job.width, job.height, size));
+        if (options.cache->fetch(hash, job.destination)) {
+            qDebug() << "Success. Please find cached image at " << job.destination;
+            return true;
+        }
+
+        // destination may be a hardlink into the cache, writing through it would alter the entry
+        QFile::remove(job.destination);
+    }
+
+    Profiler::Scope render {"render"};
+    const bool created = options.stream ? makeStreamedImage(type, job.destination, job.width, job.height, size, options.bandHeight)
+                                        : makeImage(type, job.destination, job.width, job.height, size);
+    render.end();
+    if (!created) {
+        return false;
+    }
+
+    if (options.cache) {
+        options.cache->insert(hash, job.destination);
+    }
+
+    qDebug() << "Success. Please find image at " << job.destination;
+    return true;
+}
+
+/**
+ * Jobs giving the same pixels in the same file format share the content address
+ * of the pattern cache, empty for jobs of unknown type.
+ */
+QString renderKey(const BatchManifest::Job& job)
+{
+    SizeParams size;
+    const auto type = getPatternType(job.type, size);
+    if (type == PatternType::UNKNOWN || FrameStream::isStreamPath(job.destination)) {
+        return {};
+    }
+    return PatternCache::hash(cacheKey(type, job.destination, job.width, job.height, size));
+}
+
+bool copyImage(const QString& source, const QString& destination)
+{
+    if (QFileInfo{source} == QFileInfo{destination}) {
+        return true;
+    }
+
+    QFile::remove(destination);
+    return QFile::copy(source, destination);
+}
+
+/**
+ * Copies files produced by 'source' job to the destination of identical 'job',
+ * views of an interleaved job make a single file and a pyramid adds its levels.
+ */
+bool copyOutputs(const BatchManifest::Job& source, const BatchManifest::Job& job, const JobOptions& options)
+{
+    SizeParams size;
+    getPatternType(job.type, size);
+    if (size.viewsNumber <= 0 || options.interleave) {
+        if (!copyImage(source.destination, job.destination)) {
+            return false;
+        }
+
+        // identical jobs have the same size, so the same levels
+        for (const int factor : options.pyramidFactors) {
+            const int width = job.width / factor;
+            const int height = job.height / factor;
+            if (!copyImage(levelFileName(source.destination, width, height), levelFileName(job.destination, width, height))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    for (int i = 0; i < size.viewsNumber; ++i) {
+        if (!copyImage(viewFileName(source.destination, i), viewFileName(job.destination, i))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Hashes the outputs of a job the shard wrote into its manifest.
+ */
+bool recordOutputs(ShardManifest& manifest, int jobIndex, const BatchManifest::Job& job, const JobOptions& options, qint64 firstUnit)
+{
+    SizeParams size;
+    getPatternType(job.type, size);
+    for (const int output : shardOutputs(outputCount(size, options), firstUnit, options.shard)) {
+        const QString filePath = outputFileName(job, size, options, output);
+        if (!manifest.addFile(jobIndex, output, filePath)) {
+            qWarning() << "Failed to hash " << filePath;
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Runs all jobs in this process, so start-up, font database, glyph atlases, stamps
+ * and the worker pool are shared by them. Each distinct render is done once, its
+ * duplicates get copies of the files. A sharded run renders only the outputs of
+ * its shard, records them into 'shardManifest' and does not look for duplicates,
+ * as their outputs fall into different shards.
+ */
+bool runBatch(const std::vector<BatchManifest::Job>& jobs, const JobOptions& options, ShardManifest* shardManifest = nullptr)
+{
+    std::map<QString, size_t> rendered;
+    int failures = 0;
+    qint64 firstUnit = 0;
+
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        const auto& job = jobs[i];
+        const QString key = options.shard.isSharded() ? QString{} : renderKey(job);
+        const auto done = key.isEmpty() ? rendered.end() : rendered.find(key);
+
+        SizeParams size;
+        getPatternType(job.type, size);
+        const int outputs = outputCount(size, options);
+
+        QElapsedTimer timer;
+        timer.start();
+        const bool duplicate = done != rendered.end();
+        bool result = duplicate ? copyOutputs(jobs[done->second], job, options) : runJob(job, options, firstUnit);
+        if (result && !duplicate && !key.isEmpty()) {
+            rendered.emplace(key, i);
+        }
+        if (shardManifest) {
+            shardManifest->addJob(job, outputs);
+            result = result && recordOutputs(*shardManifest, static_cast<int>(i), job, options, firstUnit);
+        }
+        firstUnit += outputs;
+        failures += result ? 0 : 1;
+
+        qInfo().noquote() << QString{"job %1 %2 %3x%4 -> %5: %6 in %7 ms"}
+                             .arg(job.line).arg(job.type).arg(job.width).arg(job.height).arg(job.destination)
+                             .arg(!result ? "FAILED" : duplicate ? QString{"copied from job %1"}.arg(jobs[done->second].line) : "done")
+                             .arg(timer.elapsed());
+    }
+
+    qInfo().noquote() << QString{"%1 of %2 jobs succeeded"}.arg(static_cast<int>(jobs.size()) - failures).arg(jobs.size());
+    return failures == 0;
+}
+
+/**
+ * Runs this shard of 'jobs' and saves its manifest into 'manifestPath' even if some
+ * jobs failed, so the merge step tells which outputs are missing.
+ */
+bool runShard(const std::vector<BatchManifest::Job>& jobs, const JobOptions& options, const QString& manifestPath)
+{
+    const QString generator = QString{"%1;encoder=%2"}.arg(CalibrationFactory::generatorVersion(),
+                                                            ImageEncoder::describe(CalibrationFactory::encoder()));
+    ShardManifest manifest {options.shard, generator};
+    const bool result = runBatch(jobs, options, &manifest);
+
+    QString error;
+    if (!manifest.save(manifestPath, error)) {
+        qWarning() << "Failed to save shard manifest: " << error;
+        return false;
+    }
+
+    qInfo().noquote() << QString{"shard %1 of %2 manifest saved at %3"}.arg(options.shard.index).arg(options.shard.count).arg(manifestPath);
+    return result;
+}
+
+/**
+ * Merge step of a sharded run.
+ */
+bool verifyShards(const QStringList& manifestPaths)
+{
+    QStringList problems;
+    int verifiedFiles = 0;
+    const bool complete = ShardManifest::verify(manifestPaths, problems, verifiedFiles);
+    for (const QString& problem : problems) {
+        qWarning().noquote() << problem;
+    }
+
+    qInfo().noquote() << QString{"%1 files verified, %2"}.arg(verifiedFiles)
+                         .arg(complete ? QString{"all shards are complete"} : QString{"%1 problems found"}.arg(problems.size()));
+    return complete;
+}
+
+/**
+ * Daemon side of a request: files are made as by a single invocation, shared memory
+ * destinations receive raw pixels.
+ */
+bool serveJob(const BatchManifest::Job& job, const JobOptions& options, QString& error)
+{
+    if (!PatternServer::isSharedMemory(job.destination)) {
+        if (!runJob(job, options)) {
+            error = "generation failed, see server log";
+            return false;
+        }
+        return true;
+    }
+
+    SizeParams size;
+    const auto type = getPatternType(job.type, size);
+    if (type == PatternType::UNKNOWN) {
+        error = "bad calibration type";
+        return false;
+    }
+
+    return PatternServer::renderShared(job.destination, static_cast<CalibrationFactory::PatternType>(type),
+                                       job.width, job.height, size.rows, size.columns, size.viewsNumber, error);
+}
+
+/**
+ * Client side of a request. A shared memory destination is created here and lives
+ * as long as this process, so it is meant for testing the server locally.
+ */
+bool requestJob(const QString& serverName, BatchManifest::Job job)
+{
+    std::unique_ptr<QSharedMemory> memory;
+    SizeParams size;
+    const auto type = getPatternType(job.type, size);
+    if (PatternServer::isSharedMemory(job.destination)) {
+        if (type == PatternType::UNKNOWN) {
+            qWarning() << "Bad calibration type provided";
+            return false;
+        }
+
+        memory.reset(new QSharedMemory{PatternServer::sharedMemoryKey(job.destination)});
+        if (!memory->create(PatternServer::sharedMemorySize(static_cast<CalibrationFactory::PatternType>(type),
+                                                            job.width, job.height, size.viewsNumber))) {
+            qWarning() << "Failed to create shared memory: " << memory->errorString();
+            return false;
+        }
+    } else {
+        // the server resolves paths against its own working directory
+        job.destination = QFileInfo{job.destination}.absoluteFilePath();
+    }
+
+    QString error;
+    if (!PatternServer::request(serverName, job, error)) {
+        qWarning() << "Request failed: " << error;
+        return false;
+    }
+
+    if (memory && !PatternServer::checkShared(*memory, static_cast<CalibrationFactory::PatternType>(type),
+                                              job.width, job.height, size.viewsNumber, error)) {
+        qWarning() << "Server reply does not match the request: " << error;
+        return false;
+    }
+
+    qDebug() << "Success. Server generated " << job.destination;
+    return true;
+}
 
-        images[i].save(imageName);
-        qDebug() << "Success. Please find image at " << imageName;
+void printStampStats()
+{
+    const auto stats = StampCache::stats();
+    qInfo().noquote() << QString{"stamps: %1 hits, %2 misses, %3 painted directly, %4 stamps, %5 KB"}
+                         .arg(stats.hits).arg(stats.misses).arg(stats.uncached)
+                         .arg(stats.stamps).arg(stats.bytes / 1024);
+}
+
+/**
+ * Looks up option 'name' before the application object and the parser exist.
+ * @return true if the option is present, its value goes to 'value' if it has one
+ */
+bool findArgument(int argc, char *argv[], const QString& name, QString* value = nullptr)
+{
+    const QByteArray option = (name.size() == 1 ? "-" : "--") + name.toLatin1();
+    for (int i = 1; i < argc; ++i) {
+        const QByteArray argument {argv[i]};
+        if (argument == option) {
+            if (value && i + 1 < argc) {
+                *value = QString::fromLocal8Bit(argv[i + 1]);
+            }
+            return true;
+        }
+        if (argument.startsWith(option + '=')) {
+            if (value) {
+                *value = QString::fromLocal8Bit(argument.mid(option.size() + 1));
+            }
+            return true;
+        }
     }
+    return false;
+}
+
+/**
+ * Profiling starts before the application object is created, so it covers the startup too.
+ */
+QString profileFilePath(int argc, char *argv[])
+{
+    QString filePath;
+    findArgument(argc, argv, Keywords::profile, &filePath);
+    return filePath;
 }
 
+/**
+ * Text and vector output are the only parts needing the GUI platform. A
+ * request is generated by the server, shard verification renders nothing and a manifest
+ * or the server may need any pattern.
+ */
+bool needsFonts(int argc, char *argv[])
+{
+    if (findArgument(argc, argv, Keywords::request) || findArgument(argc, argv, Keywords::verifyShards)) {
+        return false;
+    }
+    if (findArgument(argc, argv, Keywords::manifest) || findArgument(argc, argv, Keywords::serve)) {
+        return true;
+    }
+
+    // vector documents are written by paint devices of the GUI module
+    for (int i = 1; i < argc; ++i) {
+        const QString suffix = QFileInfo{QString::fromLocal8Bit(argv[i])}.suffix();
+        if (suffix.compare("svg", Qt::CaseInsensitive) == 0 || suffix.compare("pdf", Qt::CaseInsensitive) == 0) {
+            return true;
+        }
+    }
+
+    QString type = DEFAULT_TYPE;
+    if (!findArgument(argc, argv, Keywords::t, &type)) {
+        findArgument(argc, argv, Keywords::type, &type);
+    }
+    return !type.startsWith(Keywords::act, Qt::CaseInsensitive);
+}
+
+/**
+ * A headless run does not load the GUI platform plugin for patterns without text, it
+ * only needs the core application then. Patterns with text get the offscreen platform,
+ * unless another one is chosen explicitly, and load fonts once a label is drawn.
+ */
+std::unique_ptr<QCoreApplication> createApplication(int& argc, char *argv[])
+{
+    if (!findArgument(argc, argv, Keywords::headless)) {
+        return std::unique_ptr<QCoreApplication>{new QGuiApplication{argc, argv}};
+    }
+
+    if (!needsFonts(argc, argv)) {
+        return std::unique_ptr<QCoreApplication>{new QCoreApplication{argc, argv}};
+    }
+
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    return std::unique_ptr<QCoreApplication>{new QGuiApplication{argc, argv}};
+}
+
+/**
+ * Writes recorded stages when main returns, whichever way it does, or whenever
+ * flushed: a daemon is usually stopped without returning from main.
+ */
+class ProfileWriter
+{
+public:
+    explicit ProfileWriter(const QString& filePath)
+        : m_filePath(filePath)
+    {
+        Profiler::setEnabled(!m_filePath.isEmpty());
+    }
+
+    ~ProfileWriter()
+    {
+        flush();
+    }
+
+    void flush() const
+    {
+        if (!m_filePath.isEmpty() && !Profiler::write(m_filePath)) {
+            qWarning() << "Failed to write profile at " << m_filePath;
+        }
+    }
+
+private:
+    QString m_filePath;
+};
+
 int main(int argc, char *argv[])
 {
-    QGuiApplication app(argc, argv);
-    QGuiApplication::setApplicationName("CalibrationImageFactory");
-    QGuiApplication::setApplicationVersion("1.0");
+    const ProfileWriter profileWriter {profileFilePath(argc, argv)};
+    Profiler::Scope startup {"startup"};
+    const auto app = createApplication(argc, argv);
+    startup.end();
+    QCoreApplication::setApplicationName("CalibrationImageFactory");
+    QCoreApplication::setApplicationVersion("1.0");
 
-    QString typeStr = "rgb3x4";
+    QString typeStr = DEFAULT_TYPE;
     int width = 3840;
     int height = 2880;
 
@@ -101,15 +927,45 @@ int main(int argc, char *argv[])
     parser.addHelpOption();
     parser.addVersionOption();
 
-    parser.addPositionalArgument("destination", "File path to save image e.g /path/logo.png");
+    parser.addPositionalArgument("destination", "File path to save image e.g /path/logo.png, .svg and .pdf paths get vector output, - streams frames to stdout");
     parser.addOption({{Keywords::t, Keywords::type}, QString{"Calibration image type. Format '{%1, %2, %3}CxR' C - columns, R - rows. Default %4"}.arg(Keywords::rgb, Keywords::act, Keywords::abar, typeStr), "string", typeStr});
     parser.addOption({Keywords::w, QString{"Calibration image width > 0. Default %1"}.arg(width), "positive int", QString::number(width)});
     parser.addOption({Keywords::h, QString{"Calibration image height > 0. Default %1"}.arg(height), "positive int", QString::number(height)});
-    parser.process(app);
+    parser.addOption({{Keywords::j, Keywords::jobs}, "Number of rendering threads >= 0, 0 - one per core. Default 0", "int", "0"});
+    parser.addOption({Keywords::encodeJobs, "Number of threads encoding views >= 0, 0 - one per core. Default 0", "int", "0"});
+    parser.addOption({Keywords::queue, "Maximal number of views waiting for encoding or writing >= 0, 0 - one per rendering thread. Default 0", "int", "0"});
+    parser.addOption({Keywords::stats, "Print per stage throughput of multi-view generation and stamp cache statistics"});
+    parser.addOption({Keywords::noFastRaster, "Paint ACT patterns with QPainter instead of writing scanlines directly"});
+    parser.addOption({Keywords::noGlyphAtlas, "Draw numeric labels as text instead of blitting pre-rendered digits"});
+    parser.addOption({Keywords::noStampCache, "Paint repeated primitives directly instead of compositing cached stamps"});
+    parser.addOption({Keywords::noViewDeltas, "Paint every view whole instead of patching its differences into a shared base"});
+    parser.addOption({Keywords::argb32, "Render and save 32-bit ARGB images instead of the narrowest format of each pattern"});
+    parser.addOption({Keywords::cacheDir, "Directory of generated patterns cache, no caching if not set", "path"});
+    parser.addOption({Keywords::cacheSize, "Cache size in MB above which least recently used patterns are evicted. Default 1024", "positive int", "1024"});
+    parser.addOption({Keywords::noCache, "Neither use nor fill the patterns cache even if cache directory is set"});
+    parser.addOption({Keywords::stream, "Render image band by band and encode each band right away, for images larger than memory"});
+    parser.addOption({Keywords::bandHeight, "Rows rendered at once in stream mode > 0. Default 256", "positive int", "256"});
+    parser.addOption({Keywords::manifest, "Generate every job listed in <file>, a JSON array of {type, width, height, destination} objects or 'type width height destination' lines", "file"});
+    parser.addOption({Keywords::serve, "Keep running and generate patterns requested over local socket <name>", "name"});
+    parser.addOption({Keywords::request, "Ask server listening at <name> to generate the pattern, destination may be shm:KEY", "name"});
+    parser.addOption({Keywords::headless, "Start without GUI platform plugin, ACT patterns run on core application only, other ones on the offscreen platform"});
+    parser.addOption({Keywords::encoder, QString{"Image encoder {%1}, auto writes files Qt writes with Qt and picks one by destination suffix otherwise or in stream mode. Default auto"}.arg(ImageEncoder::backendNames().join(", ")), "name", "auto"});
+    parser.addOption({Keywords::level, "Compression level 0-9 of png and fastpng encoders, -1 - encoder default. Default -1", "int", "-1"});
+    parser.addOption({Keywords::mmap, "Create raw, PPM, PGM or BMP destination at its final size and render straight into its memory mapping, nothing is encoded"});
+    parser.addOption({Keywords::sync, "Flush memory mapped destinations to the disk before reporting success"});
+    parser.addOption({Keywords::interleave, "Interleave the views of multi-view types into one panel native image through a slanted lenticular sheet: subpixel c of pixel (x, y) shows view floor(frac((3x + c + 3y * slant + offset) / pitch) * views)", "slant,pitch[,offset]"});
+    parser.addOption({Keywords::interleaveLut, "Interleave the views of multi-view types into one panel native image, <file> holds the view index of every subpixel in its red, green and blue channels", "file"});
+    parser.addOption({Keywords::shard, "Render only shard i of N, 0 <= i < N: the outputs of the run, a file per view of multi-view types, are numbered in job order and output u belongs to shard u % N", "i/N"});
+    parser.addOption({Keywords::shardManifest, "Save the sizes and SHA-256 hashes of the files the shard wrote into <file>. Default <destination or manifest>.shard-i-of-N.json", "file"});
+    parser.addOption({Keywords::verifyShards, "Check that the shard manifests given in place of the destination cover every output of the run and match the files"});
+    parser.addOption({Keywords::pyramid, "Render the image once and save it downsampled by every factor of the list as well, <destination>_WxH levels, factors have to divide width and height", "factors"});
+    parser.addOption({Keywords::pyramidMinLabel, "Render pyramid levels natively instead of downsampling where labels would get smaller than <pixels>, 0 - always downsample. Default 0", "pixels", "0"});
+    parser.addOption({Keywords::pipeFormat, QString{"Format of the frames streamed to stdout for '-' destinations {%1}: y4m - 4:4:4 YUV4MPEG2 of frames of one size, raw - RGB888 frames with a 16-byte header each. Default y4m"}.arg(FrameStream::formatNames().join(", ")), "name", "y4m"});
+    parser.addOption({Keywords::profile, "Record duration of every stage and memory usage into <file> as Chrome trace events", "file"});
+    parser.process(*app);
 
-    if (parser.positionalArguments().size() <= 0) {
-        qWarning() << "Image destination path is expected";
-        return EXIT_FAILURE;
+    if (parser.isSet(Keywords::verifyShards)) {
+        return verifyShards(parser.positionalArguments()) ? EXIT_SUCCESS : EXIT_FAILURE;
     }
 
     bool ok = true;
@@ -125,44 +981,210 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
-    const QString filePath = parser.positionalArguments().at(0);
-    SizeParams size;
-    auto type = getPatternType(parser.value(Keywords::t), size);
-    if (size.viewsNumber > 0 && type != PatternType::UNKNOWN) {
-        makeViews(filePath, CalibrationFactory::getPattern(
-             static_cast<CalibrationFactory::PatternType>(type),
-                      width, height, size.viewsNumber));
+    const int jobs = parser.value(Keywords::jobs).toInt(&ok);
+    if (!ok || jobs < 0) {
+        qWarning() << "Jobs number should be non-negative integer";
+        return EXIT_FAILURE;
+    }
+    CalibrationFactory::setThreadCount(jobs);
+    CalibrationFactory::setFastRasterEnabled(!parser.isSet(Keywords::noFastRaster));
+    CalibrationFactory::setGlyphAtlasEnabled(!parser.isSet(Keywords::noGlyphAtlas));
+    CalibrationFactory::setStampCacheEnabled(!parser.isSet(Keywords::noStampCache));
+    CalibrationFactory::setViewDeltasEnabled(!parser.isSet(Keywords::noViewDeltas));
+    CalibrationFactory::setCompactFormatsEnabled(!parser.isSet(Keywords::argb32));
 
-        return EXIT_SUCCESS;
+    ImageEncoder::Settings encoderSettings;
+    if (!ImageEncoder::parseBackend(parser.value(Keywords::encoder), encoderSettings.backend)) {
+        qWarning() << "Encoder should be one of" << ImageEncoder::backendNames().join(", ");
+        return EXIT_FAILURE;
     }
 
-    switch (type) {
-        case PatternType::ACT:
-            if (!CalibrationFactory::makeACT(filePath, width, height, size.rows, size.columns)) {
-                qWarning() << "ACT image creation failed";
-                return EXIT_FAILURE;
-            }
-            break;
+    encoderSettings.level = parser.value(Keywords::level).toInt(&ok);
+    if (!ok || encoderSettings.level < -1 || encoderSettings.level > 9) {
+        qWarning() << "Compression level should be integer from -1 to 9";
+        return EXIT_FAILURE;
+    }
+    CalibrationFactory::setEncoder(encoderSettings);
 
-        case PatternType::RGB:
-            if (!CalibrationFactory::makeRGB(filePath, width, height, size.rows, size.columns)) {
-                qWarning() << "RGB image creation failed";
-                return EXIT_FAILURE;
-            }
-            break;
+    ViewPipeline::Settings pipelineSettings;
+    pipelineSettings.encoderThreads = parser.value(Keywords::encodeJobs).toInt(&ok);
+    if (!ok || pipelineSettings.encoderThreads < 0) {
+        qWarning() << "Encode jobs number should be non-negative integer";
+        return EXIT_FAILURE;
+    }
 
-        case PatternType::ALIGN_BAR:
-            if (!CalibrationFactory::makeABar(filePath, width, height, size.rows, size.columns)) {
-                qWarning() << "Alignment bar image creation failed";
+    pipelineSettings.queueSize = parser.value(Keywords::queue).toInt(&ok);
+    if (!ok || pipelineSettings.queueSize < 0) {
+        qWarning() << "Queue size should be non-negative integer";
+        return EXIT_FAILURE;
+    }
+
+    std::unique_ptr<PatternCache> cache;
+    if (parser.isSet(Keywords::cacheDir) && !parser.isSet(Keywords::noCache)) {
+        const qint64 cacheSizeMb = parser.value(Keywords::cacheSize).toLongLong(&ok);
+        if (!ok || cacheSizeMb <= 0) {
+            qWarning() << "Cache size should be positive integer";
+            return EXIT_FAILURE;
+        }
+
+        cache.reset(new PatternCache{parser.value(Keywords::cacheDir), cacheSizeMb * 1024 * 1024});
+        if (!cache->isValid()) {
+            qWarning() << "Cache directory can not be created, caching is disabled";
+            cache.reset();
+        }
+    }
+
+    JobOptions options;
+    options.pipelineSettings = pipelineSettings;
+    options.cache = cache.get();
+    options.printStats = parser.isSet(Keywords::stats);
+    options.stream = parser.isSet(Keywords::stream);
+    options.mapped = parser.isSet(Keywords::mmap);
+    options.sync = parser.isSet(Keywords::sync);
+    if (options.stream && options.mapped) {
+        qWarning() << "Stream and memory mapped output exclude each other";
+        return EXIT_FAILURE;
+    }
+    if (parser.isSet(Keywords::interleave) && parser.isSet(Keywords::interleaveLut)) {
+        qWarning() << "Lenticular interleaving and interleave lookup table exclude each other";
+        return EXIT_FAILURE;
+    }
+    if (parser.isSet(Keywords::interleave) && !Interleaver::parseLenticular(parser.value(Keywords::interleave), options.lens)) {
+        qWarning() << "Interleave should be 'slant,pitch[,offset]' with positive pitch";
+        return EXIT_FAILURE;
+    }
+    if (parser.isSet(Keywords::interleaveLut)) {
+        options.lookupTable = QImage{parser.value(Keywords::interleaveLut)};
+        if (options.lookupTable.isNull()) {
+            qWarning() << "Interleave lookup table can not be read";
+            return EXIT_FAILURE;
+        }
+    }
+    options.interleave = parser.isSet(Keywords::interleave) || parser.isSet(Keywords::interleaveLut);
+    if (parser.isSet(Keywords::shard) && !ShardManifest::parseShard(parser.value(Keywords::shard), options.shard)) {
+        qWarning() << "Shard should be 'i/N' with 0 <= i < N";
+        return EXIT_FAILURE;
+    }
+    if (parser.isSet(Keywords::shard) && (parser.isSet(Keywords::serve) || parser.isSet(Keywords::request))) {
+        qWarning() << "Shards are rendered by a single invocation, neither served nor requested";
+        return EXIT_FAILURE;
+    }
+    if (options.interleave && options.mapped) {
+        qWarning() << "Interleaved and memory mapped output exclude each other";
+        return EXIT_FAILURE;
+    }
+    if (parser.isSet(Keywords::pyramid)) {
+        for (const QString& value : parser.value(Keywords::pyramid).split(',', Qt::SkipEmptyParts)) {
+            const int factor = value.trimmed().toInt(&ok);
+            if (!ok || factor < 2 || factor > RasterKernels::MAX_DOWNSAMPLE_FACTOR) {
+                qWarning() << "Pyramid factors should be integers from 2 to" << RasterKernels::MAX_DOWNSAMPLE_FACTOR;
                 return EXIT_FAILURE;
             }
-            break;
+            options.pyramidFactors.push_back(factor);
+        }
 
-        default:
-            qWarning() << "Bad calibration type provided";
+        options.pyramidMinLabel = parser.value(Keywords::pyramidMinLabel).toInt(&ok);
+        if (!ok || options.pyramidMinLabel < 0) {
+            qWarning() << "Pyramid minimal label size should be non-negative integer";
+            return EXIT_FAILURE;
+        }
+
+        if (options.stream || options.mapped || options.interleave || parser.isSet(Keywords::shard)) {
+            qWarning() << "Pyramid excludes stream, memory mapped, interleaved and sharded output";
             return EXIT_FAILURE;
+        }
+    }
+    if (options.stream) {
+        options.bandHeight = parser.value(Keywords::bandHeight).toInt(&ok);
+        if (!ok || options.bandHeight <= 0) {
+            qWarning() << "Band height should be positive integer";
+            return EXIT_FAILURE;
+        }
     }
 
-    qDebug() << "Success. Please find image at " << filePath;
+    // shard manifests land next to the destination or the batch manifest unless placed explicitly
+    const auto shardManifestPath = [&parser, &options](const QString& basePath) {
+        return parser.isSet(Keywords::shardManifest) ? parser.value(Keywords::shardManifest)
+                                                     : ShardManifest::defaultPath(basePath, options.shard);
+    };
+
+    BatchManifest::Job job;
+    job.type = parser.value(Keywords::t);
+    job.width = width;
+    job.height = height;
+
+    if (parser.isSet(Keywords::serve)) {
+        PatternServer server {parser.value(Keywords::serve), [&options, &profileWriter](const BatchManifest::Job& request, QString& error) {
+            const bool served = serveJob(request, options, error);
+            profileWriter.flush();
+            return served;
+        }};
+
+        QString error;
+        if (!server.listen(error)) {
+            qWarning() << "Failed to listen: " << error;
+            return EXIT_FAILURE;
+        }
+        qInfo() << "Waiting for pattern requests at " << parser.value(Keywords::serve);
+        QObject::connect(app.get(), &QCoreApplication::aboutToQuit, [&profileWriter] { profileWriter.flush(); });
+        return app->exec();
+    }
+
+    // frames go to stdout only when a destination asks for it, nothing is written before
+    FrameStream::Format frameFormat = FrameStream::Y4M;
+    if (!FrameStream::parseFormat(parser.value(Keywords::pipeFormat), frameFormat)) {
+        qWarning() << "Pipe format should be one of" << FrameStream::formatNames().join(", ");
+        return EXIT_FAILURE;
+    }
+
+    FrameStream frames {frameFormat};
+    if (!frames.open()) {
+        qWarning() << "Stdout can not be opened for frames";
+        return EXIT_FAILURE;
+    }
+    options.frames = &frames;
+
+    if (parser.isSet(Keywords::manifest)) {
+        std::vector<BatchManifest::Job> manifestJobs;
+        QString error;
+        if (!BatchManifest::load(parser.value(Keywords::manifest), job, manifestJobs, error)) {
+            qWarning() << "Bad manifest: " << error;
+            return EXIT_FAILURE;
+        }
+
+        const bool result = parser.isSet(Keywords::shard)
+                ? runShard(manifestJobs, options, shardManifestPath(parser.value(Keywords::manifest)))
+                : runBatch(manifestJobs, options);
+        if (options.printStats) {
+            printStampStats();
+        }
+        return result ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (parser.positionalArguments().size() <= 0) {
+        qWarning() << "Image destination path is expected";
+        return EXIT_FAILURE;
+    }
+
+    job.destination = parser.positionalArguments().at(0);
+    if (parser.isSet(Keywords::request)) {
+        return requestJob(parser.value(Keywords::request), job) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (parser.isSet(Keywords::shard)) {
+        const bool result = runShard({job}, options, shardManifestPath(job.destination));
+        if (options.printStats) {
+            printStampStats();
+        }
+        return result ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (!runJob(job, options)) {
+        return EXIT_FAILURE;
+    }
+
+    if (options.printStats) {
+        printStampStats();
+    }
     return EXIT_SUCCESS;
 }